@@ -0,0 +1,262 @@
+/*
+ * epoch_reclamation.h
+ *
+ * Epoch-based memory reclamation domain for the lock-free node-based
+ * containers (K. Fraser). A thread announces the global epoch while it
+ * accesses a container; removed nodes are retired to per-thread limbo lists
+ * tagged with the epoch and deleted in batches two epochs later, when no
+ * thread can still hold a reference to them. The epoch is advanced and the
+ * limbo lists are collected at quiescent states (between thread pool tasks)
+ * or when a limbo list grows past kEpochBatchSize.
+ *
+ * Same Reclaimer interface as hazard_pointer_domain (guard, protect, reset,
+ * retire); protect is a plain load and retire a push to a thread-local list.
+ *
+ */
+
+#ifndef EPOCH_RECLAMATION_H_
+#define EPOCH_RECLAMATION_H_
+
+#include <vector> // std::vector
+#include <atomic> // std::atomic, std::atomic_thread_fence
+#include <stdexcept> // std::runtime_error
+#include "node_pool.h"
+
+// number of threads that can use the domain at the same time
+constexpr size_t kMaxEpochThreads = 256;
+
+// a thread tries to advance the epoch and collect its limbo lists once this
+// many nodes are waiting (pool workers also do it between tasks)
+constexpr size_t kEpochBatchSize = 256;
+
+class epoch_domain {
+	// epoch announcement of a thread, on its own cache line
+	struct record {
+		record() :
+				claimed(false), active(false), epoch(0) {
+		}
+		std::atomic<bool> claimed;
+		std::atomic<bool> active; // inside a guard
+		std::atomic<size_t> epoch; // epoch seen when the guard was entered
+		char padding[64 - 2 * sizeof(std::atomic<bool>)
+				- sizeof(std::atomic<size_t>)];
+	};
+
+	struct retired_node {
+		void *node;
+		void (*deleter)(void*);
+	};
+
+	// nodes retired during one epoch
+	struct limbo_list {
+		limbo_list() :
+				epoch(0) {
+		}
+		size_t epoch;
+		std::vector<retired_node> nodes;
+	};
+
+	// limbo lists left behind by an exited thread
+	struct retired_batch {
+		size_t epoch;
+		std::vector<retired_node> nodes;
+		retired_batch *next;
+	};
+
+	// record and limbo lists of this thread (epochs e - 2, e - 1, e by e % 3)
+	struct thread_state {
+		thread_state();
+		~thread_state();
+		record *announcement;
+		size_t nesting;
+		size_t Npending;
+		limbo_list limbo[3];
+	};
+
+	static record* records() {
+		static record announcements[kMaxEpochThreads];
+		return announcements;
+	}
+	static std::atomic<size_t>& records_in_use() {
+		static std::atomic<size_t> count(0);
+		return count;
+	}
+	static std::atomic<size_t>& global_epoch() {
+		static std::atomic<size_t> epoch(0);
+		return epoch;
+	}
+	static std::atomic<retired_batch*>& orphans() {
+		static std::atomic<retired_batch*> batches(nullptr);
+		return batches;
+	}
+	static thread_state& local() {
+		static thread_local thread_state state;
+		return state;
+	}
+	// state of this thread once it has used the domain (nullptr before)
+	static thread_state*& registered() {
+		static thread_local thread_state *state = nullptr;
+		return state;
+	}
+
+	static void free_nodes(std::vector<retired_node> &nodes) {
+		for (const retired_node &node : nodes)
+			node.deleter(node.node);
+		nodes.clear();
+	}
+	static bool try_advance();
+	static void collect(thread_state &state);
+	static void collect_orphans(size_t epoch);
+public:
+	class guard {
+	public:
+		guard() :
+				state(local()) {
+			if (!state.nesting++) {
+				state.announcement->active.store(true,
+						std::memory_order_relaxed);
+				state.announcement->epoch.store(
+						global_epoch().load(std::memory_order_relaxed),
+						std::memory_order_release);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+			}
+		}
+		~guard() {
+			if (!--state.nesting)
+				state.announcement->active.store(false,
+						std::memory_order_release);
+		}
+		guard(const guard&) = delete;
+		guard& operator=(const guard&) = delete;
+
+		template<typename T>
+		T* protect(const std::atomic<T*> &src) {
+			return src.load(std::memory_order_acquire);
+		}
+		void reset() {
+		}
+	private:
+		thread_state &state;
+	};
+
+	template<typename T, typename Allocator = default_node_allocator>
+	static void retire(T *node);
+
+	// called by a thread that holds no references into the containers (the
+	// thread pool workers call it between tasks): advances the epoch if all
+	// threads have caught up and deletes the nodes that became safe
+	static void quiescent_state() {
+		thread_state &state = local();
+		if (state.Npending)
+			collect(state);
+	}
+	// same for a thread that has used the domain, a no-op otherwise (does not
+	// claim a record, so threads that never touch the domain stay out of it)
+	static void quiescent_state_if_registered() {
+		thread_state *state = registered();
+		if (state && state->Npending)
+			collect(*state);
+	}
+};
+
+inline epoch_domain::thread_state::thread_state() :
+		announcement(nullptr), nesting(0), Npending(0) {
+	for (size_t i = 0; i < kMaxEpochThreads; ++i) {
+		bool expected = false;
+		if (!records()[i].claimed.load(std::memory_order_relaxed)
+				&& records()[i].claimed.compare_exchange_strong(expected, true,
+						std::memory_order_acquire)) {
+			size_t count = records_in_use().load(std::memory_order_relaxed);
+			while (count < i + 1
+					&& !records_in_use().compare_exchange_weak(count, i + 1,
+							std::memory_order_release))
+				;
+			announcement = &records()[i];
+			registered() = this;
+			return;
+		}
+	}
+	throw std::runtime_error("Too many threads in the epoch domain");
+}
+
+inline epoch_domain::thread_state::~thread_state() {
+	registered() = nullptr;
+	collect(*this);
+	for (limbo_list &list : limbo)
+		if (!list.nodes.empty()) {
+			retired_batch *batch = new retired_batch { list.epoch, std::move(
+					list.nodes), nullptr };
+			batch->next = orphans().load(std::memory_order_relaxed);
+			while (!orphans().compare_exchange_weak(batch->next, batch,
+					std::memory_order_release, std::memory_order_relaxed))
+				;
+		}
+	announcement->active.store(false, std::memory_order_relaxed);
+	announcement->claimed.store(false, std::memory_order_release);
+}
+
+inline bool epoch_domain::try_advance() {
+	size_t epoch = global_epoch().load(std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	const size_t Nrecords = records_in_use().load(std::memory_order_acquire);
+	for (size_t i = 0; i < Nrecords; ++i)
+		if (records()[i].active.load(std::memory_order_acquire)
+				&& records()[i].epoch.load(std::memory_order_acquire) != epoch)
+			return false; // a thread inside a guard has not seen this epoch yet
+	return global_epoch().compare_exchange_strong(epoch, epoch + 1,
+			std::memory_order_acq_rel, std::memory_order_relaxed);
+}
+
+// deletes the limbo lists at least two epochs old
+inline void epoch_domain::collect(thread_state &state) {
+	try_advance();
+	const size_t epoch = global_epoch().load(std::memory_order_acquire);
+	for (limbo_list &list : state.limbo)
+		if (!list.nodes.empty() && list.epoch + 2 <= epoch) {
+			state.Npending -= list.nodes.size();
+			free_nodes(list.nodes);
+		}
+	collect_orphans(epoch);
+}
+
+inline void epoch_domain::collect_orphans(size_t epoch) {
+	if (!orphans().load(std::memory_order_relaxed))
+		return;
+	retired_batch *batch = orphans().exchange(nullptr,
+			std::memory_order_acquire);
+	while (batch) {
+		retired_batch *next = batch->next;
+		if (batch->epoch + 2 <= epoch) {
+			free_nodes(batch->nodes);
+			delete batch;
+		} else {
+			batch->next = orphans().load(std::memory_order_relaxed);
+			while (!orphans().compare_exchange_weak(batch->next, batch,
+					std::memory_order_release, std::memory_order_relaxed))
+				;
+		}
+		batch = next;
+	}
+}
+
+template<typename T, typename Allocator>
+void epoch_domain::retire(T *node) {
+	thread_state &state = local();
+	const size_t epoch = global_epoch().load(std::memory_order_acquire);
+	limbo_list &list = state.limbo[epoch % 3];
+	if (list.epoch != epoch) {
+		// the list holds nodes of epoch - 3 or older
+		state.Npending -= list.nodes.size();
+		free_nodes(list.nodes);
+		list.epoch = epoch;
+	}
+	list.nodes.push_back(retired_node { node, [](void *pointer) {
+		Allocator::destroy(static_cast<T*>(pointer));
+	} });
+	// safe inside a guard as well: the lists collected are older than the
+	// epoch this thread announced
+	if (++state.Npending >= kEpochBatchSize)
+		collect(state);
+}
+
+#endif /* EPOCH_RECLAMATION_H_ */
@@ -0,0 +1,336 @@
+/*
+ * flat_combining.h
+ *
+ * Flat-combining wrapper around a sequential container (D. Hendler, I. Incze,
+ * N. Shavit, M. Tzafrir). A thread publishes its push or pop request in its
+ * publication record and then either waits for it to be served or takes the
+ * combiner lock and serves the requests of all threads in one pass, so the
+ * sequential container stays in the cache of a single thread at a time and
+ * the lock is taken once per batch instead of once per operation.
+ *
+ * A thread claims a slot on first use and keeps it until it exits; the slot
+ * selects its record in every container, so publishing a request is a plain
+ * store. Threads beyond kCombiningRecords get no slot and serve their own
+ * operations under the combiner lock.
+ *
+ * Used by ThreadSafeStack6 (std::stack) and ThreadSafeQueue7 (std::queue).
+ *
+ */
+
+#ifndef FLAT_COMBINING_H_
+#define FLAT_COMBINING_H_
+
+#include <stack> // std::stack
+#include <queue> // std::queue
+#include <memory> // std::unique_ptr
+#include <new> // placement new
+#include <utility> // std::move, std::forward
+#include <type_traits> // std::aligned_storage
+#include <atomic> // std::atomic
+#include <mutex> // std::mutex
+#include <thread> // std::this_thread::yield
+#include <exception> // std::exception_ptr
+
+// number of publication records (threads operating on a container at once)
+constexpr size_t kCombiningRecords = 64;
+
+// passes over the publication records per combiner lock acquisition
+constexpr size_t kCombiningPasses = 2;
+
+// slot of a thread without a publication record
+constexpr size_t kNoCombiningSlot = kCombiningRecords;
+
+// publication record slot of this thread, claimed on first use and released
+// when the thread exits (shared by all the containers)
+inline size_t combining_slot() {
+	static std::atomic<bool> claimed[kCombiningRecords];
+	struct slot_holder {
+		slot_holder() :
+				index(kNoCombiningSlot) {
+			for (size_t i = 0; i < kCombiningRecords; ++i) {
+				bool expected = false;
+				if (!claimed[i].load(std::memory_order_relaxed)
+						&& claimed[i].compare_exchange_strong(expected, true,
+								std::memory_order_acquire)) {
+					index = i;
+					return;
+				}
+			}
+		}
+		~slot_holder() {
+			// the records of the slot are all free, operations are synchronous
+			if (index != kNoCombiningSlot)
+				claimed[index].store(false, std::memory_order_release);
+			index = kNoCombiningSlot; // for later thread-local destructors
+		}
+		size_t index;
+	};
+	static thread_local slot_holder slot;
+	return slot.index;
+}
+
+// element served next by the sequential container
+template<typename Element, typename Container>
+Element& next_element(std::stack<Element, Container> &elements) {
+	return elements.top();
+}
+template<typename Element, typename Container>
+Element& next_element(std::queue<Element, Container> &elements) {
+	return elements.front();
+}
+
+template<typename Element, typename Sequential>
+class flat_combining_container {
+	typedef std::unique_ptr<Element> ElementUPtr;
+
+	enum RecordState {
+		kFree, kPushRequest, kPopRequest, kDoneEmpty, kDoneElement, kDoneError
+	};
+
+	// request of a thread and the element it pushes or pops
+	struct RecordData {
+		RecordData() :
+				state(kFree) {
+		}
+		Element* data() {
+			return reinterpret_cast<Element*>(&m_data);
+		}
+		std::atomic<int> state;
+		std::exception_ptr error; // of a request that failed (kDoneError)
+		typename std::aligned_storage<sizeof(Element), alignof(Element)>::type m_data;
+	};
+	// publication record, padded to whole cache lines
+	struct Record: public RecordData {
+		char padding[64 - sizeof(RecordData) % 64];
+	};
+public:
+	flat_combining_container();
+	~flat_combining_container() = default;
+	flat_combining_container(const flat_combining_container&) = delete;
+	flat_combining_container& operator=(const flat_combining_container&) = delete;
+	flat_combining_container(flat_combining_container&&) = delete;
+	flat_combining_container& operator=(flat_combining_container&&) = delete;
+
+	bool empty() const;
+	size_t size() const;
+	void push(const Element &element);
+	void push(Element &&element);
+	template<typename ...Ts>
+	void emplace(Ts &&... pars);
+	std::unique_ptr<Element> tryPop();
+	bool tryPop(Element &element);
+private:
+	Record* ownRecord();
+	void waitServed(Record &record);
+	void combine();
+	template<typename ...Ts>
+	void pushDirect(Ts &&... pars);
+	bool popDirect(Element &element);
+
+	std::mutex m_mutex_combiner;
+	Sequential m_elements; // guarded by the combiner lock
+	std::atomic<size_t> m_size;
+	std::atomic<size_t> m_records_in_use;
+	Record m_records[kCombiningRecords];
+};
+
+template<typename Element, typename Sequential>
+flat_combining_container<Element, Sequential>::flat_combining_container() :
+		m_size(0), m_records_in_use(0) {
+}
+
+template<typename Element, typename Sequential>
+bool flat_combining_container<Element, Sequential>::empty() const {
+	return !m_size.load(std::memory_order_relaxed);
+}
+
+template<typename Element, typename Sequential>
+size_t flat_combining_container<Element, Sequential>::size() const {
+	return m_size.load(std::memory_order_relaxed);
+}
+
+// record of this thread's slot (nullptr without a slot)
+template<typename Element, typename Sequential>
+typename flat_combining_container<Element, Sequential>::Record* flat_combining_container<
+		Element, Sequential>::ownRecord() {
+	const size_t index = combining_slot();
+	if (index == kNoCombiningSlot)
+		return nullptr;
+	size_t count = m_records_in_use.load(std::memory_order_relaxed);
+	while (count < index + 1
+			&& !m_records_in_use.compare_exchange_weak(count, index + 1,
+					std::memory_order_relaxed))
+		;
+	return &m_records[index];
+}
+
+// serves the published requests of all threads (the combiner lock must be
+// held); a request that throws is handed back to its thread as kDoneError
+template<typename Element, typename Sequential>
+void flat_combining_container<Element, Sequential>::combine() {
+	for (size_t pass = 0; pass < kCombiningPasses; ++pass) {
+		bool served = false;
+		const size_t Nrecords = m_records_in_use.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < Nrecords; ++i) {
+			Record &record = m_records[i];
+			const int state = record.state.load(std::memory_order_acquire);
+			if (state != kPushRequest && state != kPopRequest)
+				continue;
+			int done = kDoneEmpty;
+			try {
+				if (state == kPushRequest) {
+					m_elements.push(std::move(*record.data()));
+					record.data()->~Element();
+				} else if (!m_elements.empty()) {
+					new (record.data()) Element(
+							std::move(next_element(m_elements)));
+					m_elements.pop();
+					done = kDoneElement;
+				}
+			} catch (...) {
+				if (state == kPushRequest)
+					record.data()->~Element();
+				record.error = std::current_exception();
+				done = kDoneError;
+			}
+			m_size.store(m_elements.size(), std::memory_order_relaxed);
+			record.state.store(done, std::memory_order_release);
+			served = true;
+		}
+		if (!served)
+			break;
+	}
+}
+
+// waits until the request in the record is served, combining when the
+// combiner lock is free
+template<typename Element, typename Sequential>
+void flat_combining_container<Element, Sequential>::waitServed(Record &record) {
+	while (record.state.load(std::memory_order_acquire) < kDoneEmpty) {
+		std::unique_lock<std::mutex> lock(m_mutex_combiner, std::try_to_lock);
+		if (lock.owns_lock())
+			combine();
+		else
+			std::this_thread::yield();
+	}
+}
+
+// push of a thread without a record, served under the combiner lock
+template<typename Element, typename Sequential>
+template<typename ...Ts>
+void flat_combining_container<Element, Sequential>::pushDirect(Ts &&... pars) {
+	std::lock_guard<std::mutex> lock(m_mutex_combiner);
+	combine();
+	m_elements.emplace(std::forward<Ts>(pars)...);
+	m_size.store(m_elements.size(), std::memory_order_relaxed);
+}
+
+// pop of a thread without a record, served under the combiner lock
+template<typename Element, typename Sequential>
+bool flat_combining_container<Element, Sequential>::popDirect(Element &element) {
+	std::lock_guard<std::mutex> lock(m_mutex_combiner);
+	combine();
+	if (m_elements.empty())
+		return false;
+	element = std::move(next_element(m_elements));
+	m_elements.pop();
+	m_size.store(m_elements.size(), std::memory_order_relaxed);
+	return true;
+}
+
+template<typename Element, typename Sequential>
+void flat_combining_container<Element, Sequential>::push(const Element &element) {
+	emplace(element);
+}
+
+template<typename Element, typename Sequential>
+void flat_combining_container<Element, Sequential>::push(Element &&element) {
+	emplace(std::move(element));
+}
+
+template<typename Element, typename Sequential>
+template<typename ...Ts>
+void flat_combining_container<Element, Sequential>::emplace(Ts &&... pars) {
+	Record *record = ownRecord();
+	if (!record)
+		return pushDirect(std::forward<Ts>(pars)...);
+	new (record->data()) Element(std::forward<Ts>(pars)...);
+	record->state.store(kPushRequest, std::memory_order_release);
+	waitServed(*record);
+	const bool failed = record->state.load(std::memory_order_relaxed)
+			== kDoneError;
+	std::exception_ptr error(std::move(record->error));
+	record->error = nullptr;
+	record->state.store(kFree, std::memory_order_relaxed);
+	if (failed)
+		std::rethrow_exception(error);
+}
+
+template<typename Element, typename Sequential>
+bool flat_combining_container<Element, Sequential>::tryPop(Element &element) {
+	if (empty())
+		return false; // idle pollers do not publish requests
+	Record *record = ownRecord();
+	if (!record)
+		return popDirect(element);
+	record->state.store(kPopRequest, std::memory_order_release);
+	waitServed(*record);
+	const int state = record->state.load(std::memory_order_relaxed);
+	std::exception_ptr error(std::move(record->error));
+	record->error = nullptr;
+	if (state == kDoneElement) {
+		try {
+			element = std::move(*record->data());
+		} catch (...) {
+			record->data()->~Element();
+			record->state.store(kFree, std::memory_order_relaxed);
+			throw;
+		}
+		record->data()->~Element();
+	}
+	record->state.store(kFree, std::memory_order_relaxed);
+	if (state == kDoneError)
+		std::rethrow_exception(error);
+	return state == kDoneElement;
+}
+
+template<typename Element, typename Sequential>
+std::unique_ptr<Element> flat_combining_container<Element, Sequential>::tryPop() {
+	if (empty())
+		return ElementUPtr(nullptr); // idle pollers do not publish requests
+	Record *record = ownRecord();
+	if (!record) {
+		std::lock_guard<std::mutex> lock(m_mutex_combiner);
+		combine();
+		if (m_elements.empty())
+			return ElementUPtr(nullptr);
+		ElementUPtr front_element(
+				std::make_unique<Element>(std::move(next_element(m_elements))));
+		m_elements.pop();
+		m_size.store(m_elements.size(), std::memory_order_relaxed);
+		return front_element;
+	}
+	record->state.store(kPopRequest, std::memory_order_release);
+	waitServed(*record);
+	const int state = record->state.load(std::memory_order_relaxed);
+	std::exception_ptr error(std::move(record->error));
+	record->error = nullptr;
+	ElementUPtr front_element(nullptr);
+	if (state == kDoneElement) {
+		try {
+			front_element = std::make_unique<Element>(
+					std::move(*record->data()));
+		} catch (...) {
+			record->data()->~Element();
+			record->state.store(kFree, std::memory_order_relaxed);
+			throw;
+		}
+		record->data()->~Element();
+	}
+	record->state.store(kFree, std::memory_order_relaxed);
+	if (state == kDoneError)
+		std::rethrow_exception(error);
+	return front_element;
+}
+
+#endif /* FLAT_COMBINING_H_ */
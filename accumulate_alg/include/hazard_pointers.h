@@ -0,0 +1,223 @@
+/*
+ * hazard_pointers.h
+ *
+ * Hazard-pointer memory reclamation domain for the lock-free node-based
+ * containers (M. Michael). A thread publishes the node it is about to
+ * dereference in a hazard pointer; removed nodes are retired to a per-thread
+ * list and deleted in batches once no hazard pointer refers to them.
+ *
+ * Reclaimer interface (shared with epoch_domain):
+ *   Reclaimer::guard g;       // protects the nodes read through it while alive
+ *   T *p = g.protect(src);    // loads src and keeps *p from being deleted
+ *   g.reset();                // drops the protection early
+ *   Reclaimer::retire(p);     // deletes p once no thread can still access it
+ *   Reclaimer::template retire<T, Allocator>(p); // .. through Allocator::destroy
+ *
+ */
+
+#ifndef HAZARD_POINTERS_H_
+#define HAZARD_POINTERS_H_
+
+#include <vector> // std::vector
+#include <algorithm> // std::sort, std::binary_search, std::max
+#include <atomic> // std::atomic, std::atomic_thread_fence
+#include <stdexcept> // std::runtime_error
+#include "node_pool.h"
+
+// number of hazard pointers of all threads together
+constexpr size_t kMaxHazardPointers = 256;
+
+// a thread scans the hazard pointers once its retired list holds this many
+// nodes per hazard pointer in use (and at least kMinHazardScanSize nodes)
+constexpr size_t kHazardScanFactor = 2;
+constexpr size_t kMinHazardScanSize = 64;
+
+class hazard_pointer_domain {
+	// hazard pointer, on its own cache line
+	struct record {
+		record() :
+				active(false), pointer(nullptr) {
+		}
+		std::atomic<bool> active;
+		std::atomic<const void*> pointer;
+		char padding[64 - sizeof(std::atomic<bool>)
+				- sizeof(std::atomic<const void*>)];
+	};
+
+	struct retired_node {
+		void *node;
+		void (*deleter)(void*);
+	};
+
+	// retired nodes left behind by an exited thread
+	struct retired_batch {
+		std::vector<retired_node> nodes;
+		retired_batch *next;
+	};
+
+	// hazard pointers owned by this thread and its retired nodes
+	struct thread_state {
+		thread_state() = default;
+		~thread_state();
+		std::vector<record*> free_records;
+		std::vector<retired_node> retired_nodes;
+		// scratch space of scan, kept to avoid allocating on every scan
+		std::vector<retired_node> candidates;
+		std::vector<const void*> hazards;
+	};
+
+	static record* records() {
+		static record hazard_pointers[kMaxHazardPointers];
+		return hazard_pointers;
+	}
+	// number of records ever claimed (scans stop there)
+	static std::atomic<size_t>& records_in_use() {
+		static std::atomic<size_t> count(0);
+		return count;
+	}
+	static std::atomic<retired_batch*>& orphans() {
+		static std::atomic<retired_batch*> batches(nullptr);
+		return batches;
+	}
+	static thread_state& local() {
+		static thread_local thread_state state;
+		return state;
+	}
+
+	static record* acquire_record();
+	static void release_record(record *hazard_pointer);
+public:
+	class guard {
+	public:
+		guard() :
+				hazard_pointer(acquire_record()) {
+		}
+		~guard() {
+			release_record(hazard_pointer);
+		}
+		guard(const guard&) = delete;
+		guard& operator=(const guard&) = delete;
+
+		// loads src until the loaded pointer is published and still current
+		template<typename T>
+		T* protect(const std::atomic<T*> &src) {
+			T *pointer = src.load(std::memory_order_relaxed);
+			while (true) {
+				hazard_pointer->pointer.store(pointer,
+						std::memory_order_seq_cst);
+				T *current = src.load(std::memory_order_seq_cst);
+				if (current == pointer)
+					return pointer;
+				pointer = current;
+			}
+		}
+		void reset() {
+			hazard_pointer->pointer.store(nullptr, std::memory_order_release);
+		}
+	private:
+		record *hazard_pointer;
+	};
+
+	template<typename T, typename Allocator = default_node_allocator>
+	static void retire(T *node);
+
+	// deletes the retired nodes of this thread (and orphaned ones) that no
+	// hazard pointer refers to
+	static void scan();
+};
+
+inline hazard_pointer_domain::thread_state::~thread_state() {
+	for (record *hazard_pointer : free_records)
+		hazard_pointer->active.store(false, std::memory_order_release);
+	free_records.clear();
+	scan();
+	if (!retired_nodes.empty()) {
+		retired_batch *batch = new retired_batch { std::move(retired_nodes),
+				nullptr };
+		batch->next = orphans().load(std::memory_order_relaxed);
+		while (!orphans().compare_exchange_weak(batch->next, batch,
+				std::memory_order_release, std::memory_order_relaxed))
+			;
+	}
+}
+
+inline hazard_pointer_domain::record* hazard_pointer_domain::acquire_record() {
+	thread_state &state = local();
+	if (!state.free_records.empty()) {
+		record *hazard_pointer = state.free_records.back();
+		state.free_records.pop_back();
+		return hazard_pointer;
+	}
+	for (size_t i = 0; i < kMaxHazardPointers; ++i) {
+		bool expected = false;
+		if (!records()[i].active.load(std::memory_order_relaxed)
+				&& records()[i].active.compare_exchange_strong(expected, true,
+						std::memory_order_acquire)) {
+			size_t count = records_in_use().load(std::memory_order_relaxed);
+			while (count < i + 1
+					&& !records_in_use().compare_exchange_weak(count, i + 1,
+							std::memory_order_release))
+				;
+			return &records()[i];
+		}
+	}
+	throw std::runtime_error("No hazard pointers available");
+}
+
+inline void hazard_pointer_domain::release_record(record *hazard_pointer) {
+	hazard_pointer->pointer.store(nullptr, std::memory_order_release);
+	local().free_records.push_back(hazard_pointer);
+}
+
+template<typename T, typename Allocator>
+void hazard_pointer_domain::retire(T *node) {
+	thread_state &state = local();
+	state.retired_nodes.push_back(retired_node { node, [](void *pointer) {
+		Allocator::destroy(static_cast<T*>(pointer));
+	} });
+	if (state.retired_nodes.size()
+			>= std::max(kMinHazardScanSize,
+					kHazardScanFactor
+							* records_in_use().load(std::memory_order_relaxed)))
+		scan();
+}
+
+inline void hazard_pointer_domain::scan() {
+	thread_state &state = local();
+	std::vector<retired_node> &candidates = state.candidates;
+	candidates.swap(state.retired_nodes);
+
+	// adopt the nodes of exited threads
+	retired_batch *batch = orphans().exchange(nullptr,
+			std::memory_order_acquire);
+	while (batch) {
+		candidates.insert(candidates.end(), batch->nodes.begin(),
+				batch->nodes.end());
+		retired_batch *next = batch->next;
+		delete batch;
+		batch = next;
+	}
+
+	// the nodes were unlinked before this point, so a hazard pointer published
+	// later cannot refer to them
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	std::vector<const void*> &hazards = state.hazards;
+	hazards.clear();
+	const size_t Nrecords = records_in_use().load(std::memory_order_acquire);
+	for (size_t i = 0; i < Nrecords; ++i)
+		if (const void *pointer = records()[i].pointer.load(
+				std::memory_order_seq_cst))
+			hazards.push_back(pointer);
+	std::sort(hazards.begin(), hazards.end());
+
+	for (const retired_node &candidate : candidates) {
+		if (std::binary_search(hazards.begin(), hazards.end(),
+				(const void*) candidate.node))
+			state.retired_nodes.push_back(candidate);
+		else
+			candidate.deleter(candidate.node);
+	}
+	candidates.clear();
+}
+
+#endif /* HAZARD_POINTERS_H_ */
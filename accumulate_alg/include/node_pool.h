@@ -0,0 +1,173 @@
+/*
+ * node_pool.h
+ *
+ * Node allocation policies of the node-based containers. The pooled policy
+ * recycles fixed-size blocks through a per-thread cache; a thread hands
+ * surplus blocks to a global lock-free pool in batches of kNodeBatchSize and
+ * refills an empty cache with a whole batch, so in the steady state push and
+ * pop do not call malloc at all.
+ *
+ * Allocator interface:
+ *   T *p = Allocator::template create<T>(pars...); // constructs a T
+ *   Allocator::destroy(p);                        // destroys and frees it
+ *
+ */
+
+#ifndef NODE_POOL_H_
+#define NODE_POOL_H_
+
+#include <new> // ::operator new, ::operator delete
+#include <utility> // std::forward
+#include <cstddef> // std::max_align_t
+#include "threadsafe_queue5.h"
+
+// blocks moved between a thread cache and the global pool at once
+constexpr size_t kNodeBatchSize = 64;
+
+// batches kept by the global pool of every block size (surplus is freed)
+constexpr size_t kNodePoolBatches = 1024;
+
+// free blocks of one size and alignment
+template<size_t BlockSize, size_t BlockAlign>
+class node_pool {
+	static_assert(BlockAlign <= alignof(std::max_align_t),
+			"over-aligned nodes are not supported");
+
+	struct free_block {
+		free_block *next;
+		size_t Nblocks; // length of the batch headed by this block
+	};
+	static constexpr size_t kBlockSize =
+			BlockSize < sizeof(free_block) ? sizeof(free_block) : BlockSize;
+
+	// batches given back by the threads
+	class global_pool {
+	public:
+		global_pool() :
+				batches(kNodePoolBatches) {
+		}
+		~global_pool() {
+			free_block *batch;
+			while (batches.tryPop(batch))
+				free_batch(batch);
+		}
+		ThreadSafeQueue5<free_block*> batches;
+	};
+
+	// blocks cached by this thread
+	struct thread_cache {
+		thread_cache() :
+				head(nullptr), Nblocks(0) {
+		}
+		~thread_cache() {
+			while (head)
+				release_batch(*this);
+			cache_released() = true;
+		}
+		free_block *head;
+		size_t Nblocks;
+	};
+
+	static global_pool& global() {
+		static global_pool pool;
+		return pool;
+	}
+	static thread_cache& local() {
+		static thread_local thread_cache cache;
+		return cache;
+	}
+	// set once the cache of this thread is destroyed (the reclamation domains
+	// still free nodes at thread exit)
+	static bool& cache_released() {
+		static thread_local bool released = false;
+		return released;
+	}
+
+	static void free_batch(free_block *batch) {
+		while (batch) {
+			free_block *next = batch->next;
+			::operator delete(batch);
+			batch = next;
+		}
+	}
+	// hands the first (up to) kNodeBatchSize cached blocks to the global pool
+	static void release_batch(thread_cache &cache) {
+		free_block *batch = cache.head;
+		free_block *last = batch;
+		size_t Nblocks = 1;
+		for (; Nblocks < kNodeBatchSize && last->next; ++Nblocks)
+			last = last->next;
+		cache.head = last->next;
+		cache.Nblocks -= Nblocks;
+		last->next = nullptr;
+		batch->Nblocks = Nblocks;
+		if (!global().batches.tryPush(batch))
+			free_batch(batch); // the global pool is full
+	}
+public:
+	static void* allocate() {
+		if (cache_released())
+			return ::operator new(kBlockSize);
+		thread_cache &cache = local();
+		if (!cache.head) {
+			free_block *batch;
+			if (!global().batches.tryPop(batch))
+				return ::operator new(kBlockSize);
+			cache.head = batch;
+			cache.Nblocks = batch->Nblocks;
+		}
+		free_block *block = cache.head;
+		cache.head = block->next;
+		--cache.Nblocks;
+		return block;
+	}
+	static void deallocate(void *pointer) {
+		if (cache_released()) {
+			::operator delete(pointer);
+			return;
+		}
+		thread_cache &cache = local();
+		free_block *block = static_cast<free_block*>(pointer);
+		block->next = cache.head;
+		cache.head = block;
+		// keep one batch at hand for the next allocations
+		if (++cache.Nblocks >= 2 * kNodeBatchSize)
+			release_batch(cache);
+	}
+};
+
+// plain new and delete
+struct default_node_allocator {
+	template<typename T, typename ...Ts>
+	static T* create(Ts &&... pars) {
+		return new T(std::forward<Ts>(pars)...);
+	}
+	template<typename T>
+	static void destroy(T *node) {
+		delete node;
+	}
+};
+
+// per-thread node caches backed by a global pool
+struct pooled_node_allocator {
+	template<typename T, typename ...Ts>
+	static T* create(Ts &&... pars) {
+		typedef node_pool<sizeof(T), alignof(T)> pool;
+		void *block = pool::allocate();
+		try {
+			return new (block) T(std::forward<Ts>(pars)...);
+		} catch (...) {
+			pool::deallocate(block);
+			throw;
+		}
+	}
+	template<typename T>
+	static void destroy(T *node) {
+		if (!node)
+			return;
+		node->~T();
+		node_pool<sizeof(T), alignof(T)>::deallocate(node);
+	}
+};
+
+#endif /* NODE_POOL_H_ */
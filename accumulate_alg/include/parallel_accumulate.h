@@ -14,16 +14,118 @@
 #include <cmath>
 #include <future>
 #include <chrono>
+#include <atomic>
+#include <iterator>
 #include "thread_pool.h"
 
+// number of elements per leaf block of the reproducible reduction (fixed, so
+// that the leaf boundaries never depend on the number of threads)
+constexpr size_t kReproducibleLeafSize = 4096;
+
+// number of independent partial sums kept inside a leaf block
+constexpr size_t kReproducibleLanes = 8;
+
+// default number of elements per block handed off by the forward iterator accumulate
+constexpr size_t kForwardBlockSize = 1 << 14;
+
+// default number of elements per chunk of the dynamically scheduled accumulate
+constexpr size_t kDefaultGrainSize = 1 << 16;
+
+// Chunk scheduling of parallel_accumulate_scheduled
+enum class schedule_type {
+	dynamic, // chunks of grain elements claimed through an atomic cursor
+	guided // decreasing chunks of remaining / (2 * Nthreads), at least grain elements
+};
+
 template<typename Iterator, typename T>
 T accumulate_chunk(Iterator first, Iterator last) {
 	return std::accumulate(first, last, T { });
 }
 
+// The reproducible kernels below must keep the exact order of the floating point
+// operations, so they are compiled without -ffast-math (enabled by -Ofast)
+#pragma GCC push_options
+#pragma GCC optimize ("no-fast-math")
+
+// Plain summation state
+template<typename T>
+struct plain_accumulator {
+	plain_accumulator() :
+			sum(T { }) {
+	}
+	void add(const T &value) {
+		sum = sum + value;
+	}
+	void combine(const plain_accumulator &rhs) {
+		sum = sum + rhs.sum;
+	}
+	T result() const {
+		return sum;
+	}
+	T sum;
+};
+
+// Neumaier (improved Kahan) compensated summation state
+template<typename T>
+struct neumaier_accumulator {
+	neumaier_accumulator() :
+			sum(T { }), compensation(T { }) {
+	}
+	void add(const T &value) {
+		const T t = sum + value;
+		const bool sum_larger = std::abs(sum) >= std::abs(value);
+		const T larger = sum_larger ? sum : value;
+		const T smaller = sum_larger ? value : sum;
+		compensation = compensation + ((larger - t) + smaller);
+		sum = t;
+	}
+	void combine(const neumaier_accumulator &rhs) {
+		add(rhs.sum);
+		compensation = compensation + rhs.compensation;
+	}
+	T result() const {
+		return sum + compensation;
+	}
+	T sum;
+	T compensation;
+};
+
+// Reduces a single leaf block with a fixed number of lanes combined in a fixed order
+template<typename Accumulator, typename Iterator, typename T>
+Accumulator accumulate_leaf(Iterator first, size_t Nelements) {
+	Accumulator lanes[kReproducibleLanes];
+	size_t i = 0;
+	for (; i + kReproducibleLanes <= Nelements; i += kReproducibleLanes)
+		for (size_t lane = 0; lane < kReproducibleLanes; ++lane)
+			lanes[lane].add(static_cast<T>(first[i + lane]));
+	for (size_t lane = 0; i < Nelements; ++i, ++lane)
+		lanes[lane].add(static_cast<T>(first[i]));
+
+	for (size_t stride = 1; stride < kReproducibleLanes; stride *= 2)
+		for (size_t lane = 0; lane + stride < kReproducibleLanes;
+				lane += 2 * stride)
+			lanes[lane].combine(lanes[lane + stride]);
+	return lanes[0];
+}
+
+// Fixed-shape pairwise combine tree over the leaf results (its shape depends only
+// on the number of leaves)
+template<typename Accumulator>
+Accumulator combine_leaves(const Accumulator *leaves, size_t Nleaves) {
+	if (Nleaves == 1)
+		return leaves[0];
+	const size_t half = Nleaves / 2;
+	Accumulator result = combine_leaves(leaves, half);
+	result.combine(combine_leaves(leaves + half, Nleaves - half));
+	return result;
+}
+
+#pragma GCC pop_options
+
+// Random access iterators: Nthreads static chunks, the calling thread takes the last one
 template<typename Iterator, typename T>
-T parallel_accumulate(Iterator begin, Iterator end, T init,
-		size_t Nthreads = 2) {
+T parallel_accumulate(Iterator begin, Iterator end, T init, size_t Nthreads,
+		std::random_access_iterator_tag) {
 
 	// number of elements
 	size_t Nelements = std::distance(begin, end);
@@ -67,4 +169,225 @@ T parallel_accumulate(Iterator begin, Iterator end, T init,
 	return result;
 }
 
+// Forward (and bidirectional) iterators: the calling thread walks the sequence
+// once and hands off every block of block_size elements to the pool as soon as
+// it has passed it, so the workers reduce while the sequence is being walked.
+// The length of the range is never computed.
+template<typename Iterator, typename T>
+T parallel_accumulate_forward(Iterator begin, Iterator end, T init,
+		size_t Nthreads = 2, size_t block_size = kForwardBlockSize) {
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+
+	if (Nthreads < 2)
+		return std::accumulate(begin, end, init);
+	if (!block_size)
+		block_size = 1;
+
+	// start thread pool
+	thread_pool pool(Nthreads - 1);
+
+	// vector of futures (one per handed off block)
+	std::vector<std::future<T>> future_results;
+
+	// walk the sequence, hand off full blocks
+	Iterator start = begin;
+	size_t Nel_in_block = 0;
+	for (Iterator it = begin; it != end; ++it) {
+		if (++Nel_in_block == block_size) {
+			Iterator stop = std::next(it);
+			future_results.push_back(pool.submit([start, stop]() -> T {
+				return accumulate_chunk<Iterator, T>(start, stop);
+			}));
+			start = stop;
+			Nel_in_block = 0;
+		}
+	}
+
+	// final (partial) block
+	T result = accumulate_chunk<Iterator, T>(start, end);
+	result += init;
+
+	// sum over blocks, help the pool while waiting
+	for (auto &future_result : future_results) {
+		while (future_result.wait_for(std::chrono::seconds(0))
+				!= std::future_status::ready)
+			pool.run_pending_task();
+		result += future_result.get();
+	}
+	return result;
+}
+
+template<typename Iterator, typename T>
+T parallel_accumulate(Iterator begin, Iterator end, T init, size_t Nthreads,
+		std::forward_iterator_tag) {
+	return parallel_accumulate_forward(begin, end, init, Nthreads);
+}
+
+template<typename Iterator, typename T>
+T parallel_accumulate(Iterator begin, Iterator end, T init,
+		size_t Nthreads = 2) {
+	return parallel_accumulate(begin, end, init, Nthreads,
+			typename std::iterator_traits<Iterator>::iterator_category());
+}
+
+// Dynamically scheduled accumulate: every thread (including the calling one)
+// repeatedly claims the next chunk through a shared atomic cursor, so a thread
+// delayed by a busy core simply claims fewer chunks. Requires random access
+// iterators.
+template<typename Iterator, typename T>
+T parallel_accumulate_scheduled(Iterator begin, Iterator end, T init,
+		size_t Nthreads = 2, schedule_type schedule = schedule_type::dynamic,
+		size_t grain = kDefaultGrainSize) {
+
+	// number of elements
+	const size_t Nelements = std::distance(begin, end);
+
+	if (!Nelements)
+		return init;
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+	if (!grain)
+		grain = 1;
+
+	// index of the first unclaimed element
+	std::atomic<size_t> cursor(0);
+
+	// claims chunks until the range is exhausted, returns the partial sum
+	auto accumulate_chunks = [&]() -> T {
+		T result { };
+		while (true) {
+			size_t start = cursor.load(std::memory_order_relaxed);
+			size_t stop = Nelements;
+			if (schedule == schedule_type::dynamic) {
+				start = cursor.fetch_add(grain, std::memory_order_relaxed);
+				if (start >= Nelements)
+					break;
+				stop = std::min(start + grain, Nelements);
+			} else {
+				do {
+					if (start >= Nelements)
+						break;
+					const size_t Nremaining = Nelements - start;
+					stop = start
+							+ std::min(Nremaining,
+									std::max(grain,
+											Nremaining / (2 * Nthreads)));
+				} while (!cursor.compare_exchange_weak(start, stop,
+						std::memory_order_relaxed));
+				if (start >= Nelements)
+					break;
+			}
+			result += accumulate_chunk<Iterator, T>(begin + start,
+					begin + stop);
+		}
+		return result;
+	};
+
+	// start thread pool
+	thread_pool pool(Nthreads - 1);
+
+	// vector of futures
+	std::vector<std::future<T>> future_results(Nthreads - 1);
+	for (size_t threadNo = 0; threadNo < Nthreads - 1; ++threadNo)
+		future_results[threadNo] = pool.submit(accumulate_chunks);
+
+	// the calling thread takes part as well
+	T result = accumulate_chunks();
+	result += init;
+
+	// sum over threads
+	for (size_t threadNo = 0; threadNo < Nthreads - 1; ++threadNo)
+		result += future_results[threadNo].get();
+	return result;
+}
+
+template<typename Accumulator, typename Iterator, typename T>
+T parallel_accumulate_leaves(Iterator begin, size_t Nelements, T init,
+		size_t Nthreads) {
+
+	// number of leaf blocks (independent of the number of threads)
+	const size_t Nleaves = (Nelements + kReproducibleLeafSize - 1)
+			/ kReproducibleLeafSize;
+	std::vector<Accumulator> leaves(Nleaves);
+
+	// reduces leaf blocks [first_leaf, last_leaf)
+	auto accumulate_leaves = [begin, Nelements, &leaves](size_t first_leaf,
+			size_t last_leaf) {
+		for (size_t leafNo = first_leaf; leafNo < last_leaf; ++leafNo) {
+			const size_t offset = leafNo * kReproducibleLeafSize;
+			const size_t Nel = std::min(kReproducibleLeafSize,
+					Nelements - offset);
+			leaves[leafNo] = accumulate_leaf<Accumulator, Iterator, T>(
+					begin + offset, Nel);
+		}
+	};
+
+	if (Nthreads > Nleaves)
+		Nthreads = Nleaves;
+
+	// start thread pool
+	thread_pool pool(Nthreads - 1);
+
+	// number of leaves per chunk
+	const size_t Nleaves_per_chunk = std::ceil((double) Nleaves / Nthreads);
+
+	// vector of futures
+	std::vector<std::future<void>> future_results(Nthreads - 1);
+
+	// all chunks except the last one
+	size_t start = 0;
+	for (size_t chunkNo = 0; chunkNo < Nthreads - 1; ++chunkNo) {
+		const size_t stop = std::min(start + Nleaves_per_chunk, Nleaves);
+		future_results[chunkNo] = pool.submit([start, stop, &accumulate_leaves]() {
+			accumulate_leaves(start, stop);
+		});
+		start = stop;
+	}
+
+	// final chunk
+	accumulate_leaves(start, Nleaves);
+
+	for (size_t chunkNo = 0; chunkNo < Nthreads - 1; ++chunkNo)
+		future_results[chunkNo].get();
+
+	Accumulator result;
+	result.add(init);
+	result.combine(combine_leaves(leaves.data(), Nleaves));
+	return result.result();
+}
+
+// Reproducible accumulate: the range is split into leaf blocks of fixed size,
+// every leaf is reduced in a fixed order and the leaf results are combined by
+// a pairwise tree of fixed shape. The result is therefore bitwise identical for
+// any number of threads. With compensated == true the leaves and the tree use
+// Neumaier compensated summation. Requires random access iterators.
+template<typename Iterator, typename T>
+T parallel_accumulate_reproducible(Iterator begin, Iterator end, T init,
+		size_t Nthreads = 2, bool compensated = false) {
+
+	// number of elements
+	size_t Nelements = std::distance(begin, end);
+
+	if (!Nelements)
+		return init;
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+
+	if (compensated)
+		return parallel_accumulate_leaves<neumaier_accumulator<T>>(begin,
+				Nelements, init, Nthreads);
+	return parallel_accumulate_leaves<plain_accumulator<T>>(begin, Nelements,
+			init, Nthreads);
+}
+
 #endif /* PARALLEL_ACCUMULATE_H_ */
@@ -0,0 +1,184 @@
+/*
+ * parallel_accumulate_file.h
+ *
+ * Multithreaded accumulate algorithm over a memory-mapped binary file of packed values
+ *
+ */
+
+#ifndef PARALLEL_ACCUMULATE_FILE_H_
+#define PARALLEL_ACCUMULATE_FILE_H_
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <numeric>
+#include <future>
+#include <thread>
+#include <type_traits>
+#include <system_error>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "thread_pool.h"
+
+// number of bytes reduced between two readahead (MADV_WILLNEED) hints
+constexpr size_t kFileWindowSize = 4 << 20;
+
+// Read-only private mapping of a whole file
+class mapped_file {
+public:
+	mapped_file(const std::string &path);
+	~mapped_file();
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+	mapped_file(mapped_file&&) = delete;
+	mapped_file& operator=(mapped_file&&) = delete;
+
+	const char* data() const {
+		return static_cast<const char*>(addr);
+	}
+	size_t size() const {
+		return length;
+	}
+private:
+	int fd;
+	void *addr;
+	size_t length;
+};
+
+mapped_file::mapped_file(const std::string &path) :
+		fd(-1), addr(nullptr), length(0) {
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::system_error(errno, std::generic_category(),
+				"open " + path);
+
+	struct stat st;
+	if (::fstat(fd, &st) < 0) {
+		const int err = errno;
+		::close(fd);
+		throw std::system_error(err, std::generic_category(), "fstat " + path);
+	}
+	length = st.st_size;
+	if (!length)
+		return;
+
+	addr = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (addr == MAP_FAILED) {
+		const int err = errno;
+		::close(fd);
+		throw std::system_error(err, std::generic_category(), "mmap " + path);
+	}
+	::madvise(addr, length, MADV_SEQUENTIAL);
+}
+
+mapped_file::~mapped_file() {
+	if (length)
+		::munmap(addr, length);
+	::close(fd);
+}
+
+// Applies a madvise hint to [first, last), rounding first down to a page boundary
+void advise_range(const void *first, const void *last, int advice) {
+	static const uintptr_t page_mask = ~(uintptr_t) (::sysconf(_SC_PAGESIZE)
+			- 1);
+	const uintptr_t start = reinterpret_cast<uintptr_t>(first) & page_mask;
+	::madvise(reinterpret_cast<void*>(start),
+			reinterpret_cast<uintptr_t>(last) - start, advice);
+}
+
+// Reduces a slice (non-empty) of the mapping window by window, asking the kernel
+// to read the next window ahead while the current one is reduced
+template<typename T, typename BinaryOp>
+T accumulate_mapped_slice(const T *first, const T *last, BinaryOp op) {
+	advise_range(first, last, MADV_SEQUENTIAL);
+
+	const size_t Nel_per_window = std::max(kFileWindowSize / sizeof(T),
+			(size_t) 1);
+	T result = *first;
+	const T *window = first + 1;
+	while (window != last) {
+		const T *window_end = window
+				+ std::min(Nel_per_window, (size_t) (last - window));
+		if (window_end != last)
+			advise_range(window_end,
+					window_end
+							+ std::min(Nel_per_window,
+									(size_t) (last - window_end)),
+					MADV_WILLNEED);
+		result = std::accumulate(window, window_end, result, op);
+		window = window_end;
+	}
+	return result;
+}
+
+// Accumulates a file of packed values of type T without copying it: the file is
+// memory-mapped and every thread reduces its own page-aligned slice of the mapping.
+// Throws std::system_error if the file cannot be mapped and std::runtime_error
+// if its size is not a multiple of sizeof(T).
+template<typename T, typename BinaryOp = std::plus<T>>
+T parallel_accumulate_file(const std::string &path, T init = T { },
+		size_t Nthreads = 2, BinaryOp op = BinaryOp()) {
+	static_assert(std::is_trivially_copyable<T>::value,
+			"packed values must be trivially copyable");
+
+	mapped_file file(path);
+	if (file.size() % sizeof(T))
+		throw std::runtime_error(
+				path + ": size is not a multiple of the value size");
+
+	// number of elements
+	const size_t Nelements = file.size() / sizeof(T);
+
+	if (!Nelements)
+		return init;
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+
+	// slices are made of whole pages holding whole values (except for the last one)
+	const size_t page_size = ::sysconf(_SC_PAGESIZE);
+	const size_t unit_size =
+			page_size % sizeof(T) ? page_size * sizeof(T) : page_size;
+	const size_t Nunits = (file.size() + unit_size - 1) / unit_size;
+	if (Nthreads > Nunits)
+		Nthreads = Nunits;
+	const size_t Nel_per_slice = (Nunits + Nthreads - 1) / Nthreads
+			* (unit_size / sizeof(T));
+	const size_t Nslices = (Nelements + Nel_per_slice - 1) / Nel_per_slice;
+
+	// start thread pool
+	thread_pool pool(Nslices - 1);
+
+	// vector of futures
+	std::vector<std::future<T>> future_results(Nslices - 1);
+
+	// all slices except the last one
+	const T *start = reinterpret_cast<const T*>(file.data());
+	for (size_t sliceNo = 0; sliceNo < Nslices - 1; ++sliceNo) {
+		const T *stop = start + Nel_per_slice;
+		future_results[sliceNo] = pool.submit([start, stop, op]() -> T {
+			return accumulate_mapped_slice(start, stop, op);
+		});
+		start = stop;
+	}
+
+	// final slice
+	const T last_result = accumulate_mapped_slice(start,
+			reinterpret_cast<const T*>(file.data()) + Nelements, op);
+
+	// combine slices in order
+	T result = init;
+	for (size_t sliceNo = 0; sliceNo < Nslices - 1; ++sliceNo)
+		result = op(result, future_results[sliceNo].get());
+	return op(result, last_result);
+}
+
+#endif /* PARALLEL_ACCUMULATE_FILE_H_ */
@@ -0,0 +1,134 @@
+/*
+ * parallel_find.h
+ *
+ * Multithreaded early-terminating search algorithms (find_if, any_of, all_of, none_of)
+ *
+ */
+
+#ifndef PARALLEL_FIND_H_
+#define PARALLEL_FIND_H_
+
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <future>
+#include <atomic>
+#include <thread>
+#include "thread_pool.h"
+
+// number of elements per chunk of the search algorithms (cancellation is
+// checked between chunks)
+constexpr size_t kSearchGrainSize = 1 << 14;
+
+// Cancellation token shared by the tasks of one search: holds the smallest
+// index of a decisive element found so far
+class search_token {
+public:
+	search_token(size_t _Nelements) :
+			Nelements(_Nelements), first_hit(_Nelements) {
+	}
+	~search_token() = default;
+	search_token(const search_token&) = delete;
+	search_token& operator=(const search_token&) = delete;
+
+	void report(size_t index) {
+		size_t current = first_hit.load(std::memory_order_relaxed);
+		while (index < current
+				&& !first_hit.compare_exchange_weak(current, index,
+						std::memory_order_relaxed))
+			;
+	}
+	// true if nothing at or after index can change the answer
+	bool cancelled(size_t index, bool ordered) const {
+		const size_t hit = first_hit.load(std::memory_order_relaxed);
+		return ordered ? hit <= index : hit != Nelements;
+	}
+	size_t result() const {
+		return first_hit.load(std::memory_order_relaxed);
+	}
+private:
+	const size_t Nelements;
+	std::atomic<size_t> first_hit;
+};
+
+// Searches [first, last) for an element satisfying pred. Chunks are claimed in
+// order through an atomic cursor; ordered == true returns the first such
+// element (chunks past the best hit are skipped), ordered == false returns as
+// soon as any element is found.
+template<typename Iterator, typename Predicate>
+Iterator parallel_search(Iterator first, Iterator last, Predicate pred,
+		size_t Nthreads, bool ordered) {
+
+	// number of elements
+	const size_t Nelements = std::distance(first, last);
+
+	if (!Nelements)
+		return last;
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+
+	search_token token(Nelements);
+	std::atomic<size_t> cursor(0);
+
+	// claims and searches chunks until the token cancels the search
+	auto search_chunks = [&]() {
+		while (true) {
+			const size_t start = cursor.fetch_add(kSearchGrainSize,
+					std::memory_order_relaxed);
+			if (start >= Nelements || token.cancelled(start, ordered))
+				break;
+			const size_t stop = std::min(start + kSearchGrainSize, Nelements);
+			Iterator found = std::find_if(first + start, first + stop, pred);
+			if (found != first + stop)
+				token.report(found - first);
+		}
+	};
+
+	// start thread pool
+	thread_pool pool(Nthreads - 1);
+
+	// vector of futures
+	std::vector<std::future<void>> future_results(Nthreads - 1);
+	for (size_t threadNo = 0; threadNo < Nthreads - 1; ++threadNo)
+		future_results[threadNo] = pool.submit(search_chunks);
+
+	// the calling thread takes part as well
+	search_chunks();
+	for (auto &future_result : future_results)
+		future_result.get();
+
+	return first + token.result();
+}
+
+// Returns the first element satisfying pred (last if none), requires random access iterators
+template<typename Iterator, typename Predicate>
+Iterator parallel_find_if(Iterator first, Iterator last, Predicate pred,
+		size_t Nthreads = 2) {
+	return parallel_search(first, last, pred, Nthreads, true);
+}
+
+template<typename Iterator, typename Predicate>
+bool parallel_any_of(Iterator first, Iterator last, Predicate pred,
+		size_t Nthreads = 2) {
+	return parallel_search(first, last, pred, Nthreads, false) != last;
+}
+
+template<typename Iterator, typename Predicate>
+bool parallel_none_of(Iterator first, Iterator last, Predicate pred,
+		size_t Nthreads = 2) {
+	return !parallel_any_of(first, last, pred, Nthreads);
+}
+
+template<typename Iterator, typename Predicate>
+bool parallel_all_of(Iterator first, Iterator last, Predicate pred,
+		size_t Nthreads = 2) {
+	typedef typename std::iterator_traits<Iterator>::reference Reference;
+	return !parallel_any_of(first, last, [&pred](Reference value) -> bool {
+		return !pred(value);
+	}, Nthreads);
+}
+
+#endif /* PARALLEL_FIND_H_ */
@@ -0,0 +1,154 @@
+/*
+ * parallel_histogram.h
+ *
+ * Multithreaded histogram (bucketed counting) algorithm
+ *
+ */
+
+#ifndef PARALLEL_HISTOGRAM_H_
+#define PARALLEL_HISTOGRAM_H_
+
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <algorithm>
+#include <cstdint>
+#include <future>
+#include <thread>
+#include "thread_pool.h"
+
+// size of a cache line in bytes
+constexpr size_t kCacheLineSize = 64;
+
+// histograms with up to this many bins are split into kHistogramLanes
+// sub-histograms per thread, so that runs of equal bins do not serialise on
+// store-to-load forwarding of the same counter
+constexpr size_t kSmallHistogramBins = 1024;
+constexpr size_t kHistogramLanes = 4;
+
+// Counts [first, last) into the private histogram of a thread (lane 0 holds
+// the result, the other lanes are scratch space)
+template<typename Iterator, typename BucketFn>
+void histogram_chunk(Iterator first, Iterator last, size_t Nbins,
+		BucketFn bucket_fn, size_t *counts, size_t Nlanes) {
+	if (Nlanes == kHistogramLanes) {
+		size_t *lane1 = counts + Nbins;
+		size_t *lane2 = counts + 2 * Nbins;
+		size_t *lane3 = counts + 3 * Nbins;
+		for (; std::distance(first, last) >= (ptrdiff_t) kHistogramLanes;
+				first += kHistogramLanes) {
+			const size_t bin0 = bucket_fn(first[0]);
+			const size_t bin1 = bucket_fn(first[1]);
+			const size_t bin2 = bucket_fn(first[2]);
+			const size_t bin3 = bucket_fn(first[3]);
+			counts[bin0 < Nbins ? bin0 : 0] += bin0 < Nbins;
+			lane1[bin1 < Nbins ? bin1 : 0] += bin1 < Nbins;
+			lane2[bin2 < Nbins ? bin2 : 0] += bin2 < Nbins;
+			lane3[bin3 < Nbins ? bin3 : 0] += bin3 < Nbins;
+		}
+		// fold the lanes
+		for (size_t bin = 0; bin < Nbins; ++bin)
+			counts[bin] += lane1[bin] + lane2[bin] + lane3[bin];
+	}
+	for (; first != last; ++first) {
+		const size_t bin = bucket_fn(*first);
+		if (bin < Nbins)
+			++counts[bin];
+	}
+}
+
+// Counts the elements of [first, last) per bin, bucket_fn maps an element to
+// its bin (elements mapped to a bin >= Nbins are not counted). Every thread
+// counts into a private, cache-line padded histogram; the private histograms
+// are then merged by a parallel column reduction. Requires random access iterators.
+template<typename Iterator, typename BucketFn>
+std::vector<size_t> parallel_histogram(Iterator first, Iterator last,
+		size_t Nbins, BucketFn bucket_fn, size_t Nthreads = 2) {
+
+	std::vector<size_t> histogram(Nbins);
+
+	// number of elements
+	const size_t Nelements = std::distance(first, last);
+
+	if (!Nelements || !Nbins)
+		return histogram;
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+	if (Nthreads > Nelements)
+		Nthreads = Nelements;
+
+	// private histograms, every row starts on its own cache line
+	const size_t Nlanes = Nbins <= kSmallHistogramBins ? kHistogramLanes : 1;
+	const size_t Ncounts_per_line = kCacheLineSize / sizeof(size_t);
+	const size_t row_size = (Nlanes * Nbins + Ncounts_per_line - 1)
+			/ Ncounts_per_line * Ncounts_per_line;
+	std::unique_ptr<size_t[]> storage(
+			new size_t[Nthreads * row_size + Ncounts_per_line]());
+	size_t *rows = reinterpret_cast<size_t*>((reinterpret_cast<uintptr_t>(storage.get())
+			+ kCacheLineSize - 1) / kCacheLineSize * kCacheLineSize);
+
+	// start thread pool
+	thread_pool pool(Nthreads - 1);
+
+	// vector of futures
+	std::vector<std::future<void>> future_results(Nthreads - 1);
+
+	// counting: all chunks except the last one
+	const size_t Nel_per_chunk = Nelements / Nthreads;
+	for (size_t chunkNo = 0; chunkNo < Nthreads - 1; ++chunkNo) {
+		Iterator start = first + chunkNo * Nel_per_chunk;
+		Iterator stop = start + Nel_per_chunk;
+		size_t *counts = rows + chunkNo * row_size;
+		future_results[chunkNo] = pool.submit(
+				[start, stop, Nbins, bucket_fn, counts, Nlanes]() {
+					histogram_chunk(start, stop, Nbins, bucket_fn, counts,
+							Nlanes);
+				});
+	}
+
+	// counting: final chunk
+	histogram_chunk(first + (Nthreads - 1) * Nel_per_chunk, last, Nbins,
+			bucket_fn, rows + (Nthreads - 1) * row_size, Nlanes);
+	for (auto &future_result : future_results)
+		future_result.get();
+
+	// merging: every thread sums a range of columns over all private histograms
+	auto merge_columns = [&histogram, rows, row_size, Nthreads](size_t start,
+			size_t stop) {
+		for (size_t rowNo = 0; rowNo < Nthreads; ++rowNo) {
+			const size_t *counts = rows + rowNo * row_size;
+			for (size_t bin = start; bin < stop; ++bin)
+				histogram[bin] += counts[bin];
+		}
+	};
+	const size_t Ncolumns = ((Nbins + Nthreads - 1) / Nthreads
+			+ Ncounts_per_line - 1) / Ncounts_per_line * Ncounts_per_line;
+	size_t Nmerges = 0;
+	for (size_t start = 0; start + Ncolumns < Nbins; start += Ncolumns)
+		future_results[Nmerges++] = pool.submit([start, Ncolumns, &merge_columns]() {
+			merge_columns(start, start + Ncolumns);
+		});
+	merge_columns(Nmerges * Ncolumns, Nbins);
+	for (size_t mergeNo = 0; mergeNo < Nmerges; ++mergeNo)
+		future_results[mergeNo].get();
+	return histogram;
+}
+
+// Counts the elements of [first, last) in Nbins equal-width bins over [lo, hi)
+// (elements outside [lo, hi) are not counted)
+template<typename Iterator, typename T>
+std::vector<size_t> parallel_histogram(Iterator first, Iterator last,
+		size_t Nbins, T lo, T hi, size_t Nthreads = 2) {
+	const double scale = Nbins / ((double) hi - (double) lo);
+	return parallel_histogram(first, last, Nbins,
+			[lo, hi, scale, Nbins](const T &value) -> size_t {
+				if (!(value >= lo && value < hi))
+					return Nbins;
+				return std::min((size_t) ((value - lo) * scale), Nbins - 1);
+			}, Nthreads);
+}
+
+#endif /* PARALLEL_HISTOGRAM_H_ */
@@ -0,0 +1,240 @@
+/*
+ * parallel_reduce_by_key.h
+ *
+ * Multithreaded reduce-by-key (group-by aggregation) algorithms
+ *
+ */
+
+#ifndef PARALLEL_REDUCE_BY_KEY_H_
+#define PARALLEL_REDUCE_BY_KEY_H_
+
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <iterator>
+#include <functional>
+#include <algorithm>
+#include <future>
+#include <thread>
+#include "thread_pool.h"
+
+// Segmented reduction of [keys_first, keys_last): one (key, value) pair per run
+// of equal keys
+template<typename KeyIterator, typename ValueIterator, typename Key,
+		typename Value, typename BinaryOp>
+std::vector<std::pair<Key, Value>> reduce_segments(KeyIterator keys_first,
+		KeyIterator keys_last, ValueIterator values_first, BinaryOp op) {
+	std::vector<std::pair<Key, Value>> segments;
+	for (; keys_first != keys_last; ++keys_first, ++values_first) {
+		if (!segments.empty() && segments.back().first == *keys_first)
+			segments.back().second = op(segments.back().second, *values_first);
+		else
+			segments.emplace_back(*keys_first, *values_first);
+	}
+	return segments;
+}
+
+// Reduces the values of every run of equal keys (keys sorted, or at least grouped).
+// Every chunk is reduced to its segments in parallel, then the segments that
+// straddle chunk borders are fixed up and the chunk results are concatenated in
+// parallel. Returns the (key, value) pairs in key order. Requires random access
+// iterators.
+template<typename KeyIterator, typename ValueIterator,
+		typename BinaryOp = std::plus<
+				typename std::iterator_traits<ValueIterator>::value_type>>
+std::vector<
+		std::pair<typename std::iterator_traits<KeyIterator>::value_type,
+				typename std::iterator_traits<ValueIterator>::value_type>> parallel_reduce_by_sorted_key(
+		KeyIterator keys_first, KeyIterator keys_last,
+		ValueIterator values_first, size_t Nthreads = 2, BinaryOp op =
+				BinaryOp()) {
+	typedef typename std::iterator_traits<KeyIterator>::value_type Key;
+	typedef typename std::iterator_traits<ValueIterator>::value_type Value;
+	typedef std::vector<std::pair<Key, Value>> Segments;
+
+	// number of elements
+	const size_t Nelements = std::distance(keys_first, keys_last);
+
+	if (!Nelements)
+		return Segments();
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+	if (Nthreads > Nelements)
+		Nthreads = Nelements;
+
+	// start thread pool
+	thread_pool pool(Nthreads - 1);
+
+	// vector of futures
+	std::vector<std::future<void>> future_results(Nthreads - 1);
+
+	// segmented reduction of every chunk
+	std::vector<Segments> chunks(Nthreads);
+	const size_t Nel_per_chunk = Nelements / Nthreads;
+	auto reduce_chunk = [=, &chunks](size_t chunkNo) {
+		const size_t start = chunkNo * Nel_per_chunk;
+		const size_t stop =
+				chunkNo == Nthreads - 1 ? Nelements : start + Nel_per_chunk;
+		chunks[chunkNo] = reduce_segments<KeyIterator, ValueIterator, Key,
+				Value>(keys_first + start, keys_first + stop,
+				values_first + start, op);
+	};
+	for (size_t chunkNo = 0; chunkNo < Nthreads - 1; ++chunkNo)
+		future_results[chunkNo] = pool.submit([chunkNo, &reduce_chunk]() {
+			reduce_chunk(chunkNo);
+		});
+	reduce_chunk(Nthreads - 1);
+	for (auto &future_result : future_results)
+		future_result.get();
+
+	// fix-up: a chunk starting with the key the previous chunk ended with
+	// contributes its first segment to that previous segment
+	std::vector<size_t> first_kept(Nthreads, 0);
+	std::pair<Key, Value> *last_kept = &chunks[0].back();
+	for (size_t chunkNo = 1; chunkNo < Nthreads; ++chunkNo) {
+		Segments &segments = chunks[chunkNo];
+		if (segments.front().first == last_kept->first) {
+			last_kept->second = op(last_kept->second, segments.front().second);
+			first_kept[chunkNo] = 1;
+		}
+		if (segments.size() > first_kept[chunkNo])
+			last_kept = &segments.back();
+	}
+
+	// offsets of the chunks in the result
+	std::vector<size_t> offsets(Nthreads + 1, 0);
+	for (size_t chunkNo = 0; chunkNo < Nthreads; ++chunkNo)
+		offsets[chunkNo + 1] = offsets[chunkNo] + chunks[chunkNo].size()
+				- first_kept[chunkNo];
+
+	// concatenation
+	Segments result(offsets[Nthreads]);
+	auto move_chunk = [&](size_t chunkNo) {
+		std::move(chunks[chunkNo].begin() + first_kept[chunkNo],
+				chunks[chunkNo].end(), result.begin() + offsets[chunkNo]);
+	};
+	for (size_t chunkNo = 0; chunkNo < Nthreads - 1; ++chunkNo)
+		future_results[chunkNo] = pool.submit([chunkNo, &move_chunk]() {
+			move_chunk(chunkNo);
+		});
+	move_chunk(Nthreads - 1);
+	for (auto &future_result : future_results)
+		future_result.get();
+	return result;
+}
+
+// Reduces the values of every distinct key (keys in any order). Every thread
+// pre-aggregates its chunk into private hash maps, one per partition of the key
+// space; each partition is then merged by its own thread and the partitions are
+// concatenated. For every key the values are combined in input order. The
+// order of the returned (key, value) pairs is unspecified. Requires random
+// access iterators.
+template<typename KeyIterator, typename ValueIterator,
+		typename BinaryOp = std::plus<
+				typename std::iterator_traits<ValueIterator>::value_type>>
+std::vector<
+		std::pair<typename std::iterator_traits<KeyIterator>::value_type,
+				typename std::iterator_traits<ValueIterator>::value_type>> parallel_reduce_by_key(
+		KeyIterator keys_first, KeyIterator keys_last,
+		ValueIterator values_first, size_t Nthreads = 2, BinaryOp op =
+				BinaryOp()) {
+	typedef typename std::iterator_traits<KeyIterator>::value_type Key;
+	typedef typename std::iterator_traits<ValueIterator>::value_type Value;
+	typedef std::unordered_map<Key, Value> Map;
+
+	// number of elements
+	const size_t Nelements = std::distance(keys_first, keys_last);
+
+	if (!Nelements)
+		return std::vector<std::pair<Key, Value>>();
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+	if (Nthreads > Nelements)
+		Nthreads = Nelements;
+
+	// start thread pool
+	thread_pool pool(Nthreads - 1);
+
+	// vector of futures
+	std::vector<std::future<void>> future_results(Nthreads - 1);
+
+	// pre-aggregation: maps[chunkNo][partitionNo]
+	const size_t Npartitions = Nthreads;
+	std::vector<std::vector<Map>> maps(Nthreads, std::vector<Map>(Npartitions));
+	const size_t Nel_per_chunk = Nelements / Nthreads;
+	auto aggregate_chunk = [=, &maps](size_t chunkNo) {
+		const size_t start = chunkNo * Nel_per_chunk;
+		const size_t stop =
+				chunkNo == Nthreads - 1 ? Nelements : start + Nel_per_chunk;
+		std::hash<Key> hash;
+		KeyIterator key = keys_first + start;
+		ValueIterator value = values_first + start;
+		for (size_t i = start; i < stop; ++i, ++key, ++value) {
+			Map &map = maps[chunkNo][
+					Npartitions > 1 ? hash(*key) % Npartitions : 0];
+			auto found = map.find(*key);
+			if (found == map.end())
+				map.emplace(*key, *value);
+			else
+				found->second = op(found->second, *value);
+		}
+	};
+	for (size_t chunkNo = 0; chunkNo < Nthreads - 1; ++chunkNo)
+		future_results[chunkNo] = pool.submit([chunkNo, &aggregate_chunk]() {
+			aggregate_chunk(chunkNo);
+		});
+	aggregate_chunk(Nthreads - 1);
+	for (auto &future_result : future_results)
+		future_result.get();
+
+	// partitioned merge into maps[0][partitionNo], chunks in input order
+	auto merge_partition = [&](size_t partitionNo) {
+		Map &merged = maps[0][partitionNo];
+		for (size_t chunkNo = 1; chunkNo < Nthreads; ++chunkNo) {
+			for (auto &entry : maps[chunkNo][partitionNo]) {
+				auto found = merged.find(entry.first);
+				if (found == merged.end())
+					merged.emplace(entry.first, std::move(entry.second));
+				else
+					found->second = op(found->second, entry.second);
+			}
+			Map().swap(maps[chunkNo][partitionNo]);
+		}
+	};
+	for (size_t partitionNo = 0; partitionNo < Npartitions - 1; ++partitionNo)
+		future_results[partitionNo] = pool.submit(
+				[partitionNo, &merge_partition]() {
+					merge_partition(partitionNo);
+				});
+	merge_partition(Npartitions - 1);
+	for (auto &future_result : future_results)
+		future_result.get();
+
+	// concatenation
+	std::vector<size_t> offsets(Npartitions + 1, 0);
+	for (size_t partitionNo = 0; partitionNo < Npartitions; ++partitionNo)
+		offsets[partitionNo + 1] = offsets[partitionNo]
+				+ maps[0][partitionNo].size();
+	std::vector<std::pair<Key, Value>> result(offsets[Npartitions]);
+	auto move_partition = [&](size_t partitionNo) {
+		std::copy(maps[0][partitionNo].begin(), maps[0][partitionNo].end(),
+				result.begin() + offsets[partitionNo]);
+	};
+	for (size_t partitionNo = 0; partitionNo < Npartitions - 1; ++partitionNo)
+		future_results[partitionNo] = pool.submit(
+				[partitionNo, &move_partition]() {
+					move_partition(partitionNo);
+				});
+	move_partition(Npartitions - 1);
+	for (auto &future_result : future_results)
+		future_result.get();
+	return result;
+}
+
+#endif /* PARALLEL_REDUCE_BY_KEY_H_ */
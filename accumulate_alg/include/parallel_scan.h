@@ -0,0 +1,278 @@
+/*
+ * parallel_scan.h
+ *
+ * Multithreaded inclusive/exclusive prefix scan algorithms
+ *
+ */
+
+#ifndef PARALLEL_SCAN_H_
+#define PARALLEL_SCAN_H_
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <iterator>
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <atomic>
+#include <thread>
+#include "thread_pool.h"
+
+// number of elements per tile of the single-pass (decoupled look-back) scan
+constexpr size_t kScanTileSize = 1 << 14;
+
+// Reduces [first, last) (non-empty) without requiring an identity element
+template<typename Iterator, typename T, typename BinaryOp>
+T reduce_chunk(Iterator first, Iterator last, BinaryOp op) {
+	T result = *first;
+	for (++first; first != last; ++first)
+		result = op(result, *first);
+	return result;
+}
+
+// Scans [first, last) into d_first starting from prefix, returns the last prefix
+template<typename InputIterator, typename OutputIterator, typename T,
+		typename BinaryOp>
+T scan_chunk(InputIterator first, InputIterator last, OutputIterator d_first,
+		T prefix, BinaryOp op, bool exclusive) {
+	for (; first != last; ++first, ++d_first) {
+		T value = *first;
+		if (exclusive) {
+			*d_first = prefix;
+			prefix = op(prefix, value);
+		} else {
+			prefix = op(prefix, value);
+			*d_first = prefix;
+		}
+	}
+	return prefix;
+}
+
+// Scans [first, last) (non-empty) into d_first starting from the optional prefix
+template<typename InputIterator, typename OutputIterator, typename T,
+		typename BinaryOp>
+T scan_first_chunk(InputIterator first, InputIterator last, OutputIterator d_first,
+		const T *prefix, BinaryOp op, bool exclusive) {
+	if (prefix)
+		return scan_chunk(first, last, d_first, *prefix, op, exclusive);
+
+	// inclusive scan without prefix: the first element is its own prefix
+	T first_value = *first;
+	*d_first = first_value;
+	return scan_chunk(std::next(first), last, std::next(d_first), first_value,
+			op, false);
+}
+
+// Two-pass chunked scan: (1) reduce each chunk, (2) scan the chunk totals,
+// (3) rescan each chunk with its offset. The first chunk is scanned directly.
+template<typename InputIterator, typename OutputIterator, typename T,
+		typename BinaryOp>
+OutputIterator parallel_scan(InputIterator first, InputIterator last,
+		OutputIterator d_first, const T *init, BinaryOp op, bool exclusive,
+		size_t Nthreads) {
+
+	// number of elements
+	const size_t Nelements = std::distance(first, last);
+
+	if (!Nelements)
+		return d_first;
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+	if (Nthreads > Nelements)
+		Nthreads = Nelements;
+
+	// start thread pool
+	thread_pool pool(Nthreads - 1);
+
+	// number of elements per chunk
+	const size_t Nel_per_chunk = std::ceil((double) Nelements / Nthreads);
+	const size_t Nchunks = (Nelements + Nel_per_chunk - 1) / Nel_per_chunk;
+
+	// first pass: chunk totals
+	std::vector<T> totals(Nchunks);
+	std::vector<std::future<void>> future_results(Nchunks - 1);
+	for (size_t chunkNo = 0; chunkNo < Nchunks; ++chunkNo) {
+		const size_t start = chunkNo * Nel_per_chunk;
+		const size_t stop = std::min(start + Nel_per_chunk, Nelements);
+		auto task = [=, &totals]() {
+			if (chunkNo == 0)
+				totals[chunkNo] = scan_first_chunk(first, first + stop, d_first,
+						init, op, exclusive);
+			else
+				totals[chunkNo] = reduce_chunk<InputIterator, T>(first + start,
+						first + stop, op);
+		};
+		if (chunkNo < Nchunks - 1)
+			future_results[chunkNo] = pool.submit(task);
+		else
+			task();
+	}
+	for (auto &future_result : future_results)
+		future_result.get();
+
+	// scan of the chunk totals (the first chunk total already includes init)
+	for (size_t chunkNo = 1; chunkNo < Nchunks; ++chunkNo)
+		totals[chunkNo] = op(totals[chunkNo - 1], totals[chunkNo]);
+
+	// second pass: rescan all chunks except the first one with their offsets
+	for (size_t chunkNo = 1; chunkNo < Nchunks; ++chunkNo) {
+		const size_t start = chunkNo * Nel_per_chunk;
+		const size_t stop = std::min(start + Nel_per_chunk, Nelements);
+		auto task = [=, &totals]() {
+			scan_chunk(first + start, first + stop, d_first + start,
+					totals[chunkNo - 1], op, exclusive);
+		};
+		if (chunkNo < Nchunks - 1)
+			future_results[chunkNo - 1] = pool.submit(task);
+		else
+			task();
+	}
+	for (size_t chunkNo = 1; chunkNo < Nchunks - 1; ++chunkNo)
+		future_results[chunkNo - 1].get();
+
+	return d_first + Nelements;
+}
+
+// Single-pass scan with decoupled look-back: tiles are claimed in order, every
+// tile publishes its aggregate, then walks back over its predecessors until it
+// finds one with an inclusive prefix, publishes its own inclusive prefix and
+// scans its elements with the resulting offset.
+template<typename InputIterator, typename OutputIterator, typename T,
+		typename BinaryOp>
+OutputIterator parallel_scan_lookback(InputIterator first, InputIterator last,
+		OutputIterator d_first, const T *init, BinaryOp op, bool exclusive,
+		size_t Nthreads) {
+
+	enum tile_flag {
+		not_ready = 0, aggregate_ready, inclusive_ready
+	};
+
+	struct tile_status {
+		tile_status() :
+				flag(not_ready) {
+		}
+		std::atomic<int> flag;
+		T aggregate;
+		T inclusive;
+	};
+
+	// number of elements
+	const size_t Nelements = std::distance(first, last);
+
+	if (!Nelements)
+		return d_first;
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+
+	const size_t Ntiles = (Nelements + kScanTileSize - 1) / kScanTileSize;
+	if (Nthreads > Ntiles)
+		Nthreads = Ntiles;
+	std::unique_ptr<tile_status[]> tiles(new tile_status[Ntiles]);
+	std::atomic<size_t> next_tile(0);
+
+	auto scan_tiles = [&]() {
+		for (size_t tileNo = next_tile.fetch_add(1); tileNo < Ntiles; tileNo =
+				next_tile.fetch_add(1)) {
+			const size_t start = tileNo * kScanTileSize;
+			const size_t stop = std::min(start + kScanTileSize, Nelements);
+			tile_status &tile = tiles[tileNo];
+
+			if (tileNo == 0) {
+				tile.inclusive = scan_first_chunk(first, first + stop, d_first,
+						init, op, exclusive);
+				tile.flag.store(inclusive_ready, std::memory_order_release);
+				continue;
+			}
+
+			// publish the aggregate of this tile
+			tile.aggregate = reduce_chunk<InputIterator, T>(first + start,
+					first + stop, op);
+			tile.flag.store(aggregate_ready, std::memory_order_release);
+
+			// look back (predecessors are always claimed by running tasks)
+			T prefix { };
+			for (size_t lookNo = tileNo; lookNo-- > 0;) {
+				int flag;
+				while ((flag = tiles[lookNo].flag.load(std::memory_order_acquire))
+						== not_ready)
+					std::this_thread::yield();
+				const T &value =
+						flag == inclusive_ready ?
+								tiles[lookNo].inclusive :
+								tiles[lookNo].aggregate;
+				prefix = lookNo == tileNo - 1 ? value : op(value, prefix);
+				if (flag == inclusive_ready)
+					break;
+			}
+
+			// publish the inclusive prefix of this tile
+			tile.inclusive = op(prefix, tile.aggregate);
+			tile.flag.store(inclusive_ready, std::memory_order_release);
+
+			scan_chunk(first + start, first + stop, d_first + start, prefix, op,
+					exclusive);
+		}
+	};
+
+	// start thread pool
+	thread_pool pool(Nthreads - 1);
+	std::vector<std::future<void>> future_results(Nthreads - 1);
+	for (size_t threadNo = 0; threadNo < Nthreads - 1; ++threadNo)
+		future_results[threadNo] = pool.submit(scan_tiles);
+	scan_tiles();
+	for (auto &future_result : future_results)
+		future_result.get();
+
+	return d_first + Nelements;
+}
+
+// Inclusive prefix scan (two-pass), requires random access iterators
+template<typename InputIterator, typename OutputIterator,
+		typename BinaryOp = std::plus<
+				typename std::iterator_traits<InputIterator>::value_type>>
+OutputIterator parallel_inclusive_scan(InputIterator first, InputIterator last,
+		OutputIterator d_first, size_t Nthreads = 2, BinaryOp op = BinaryOp()) {
+	typedef typename std::iterator_traits<InputIterator>::value_type T;
+	return parallel_scan(first, last, d_first, (const T*) nullptr, op, false,
+			Nthreads);
+}
+
+// Exclusive prefix scan (two-pass), requires random access iterators
+template<typename InputIterator, typename OutputIterator, typename T,
+		typename BinaryOp = std::plus<T>>
+OutputIterator parallel_exclusive_scan(InputIterator first, InputIterator last,
+		OutputIterator d_first, T init, size_t Nthreads = 2, BinaryOp op =
+				BinaryOp()) {
+	return parallel_scan(first, last, d_first, &init, op, true, Nthreads);
+}
+
+// Inclusive prefix scan (single-pass, decoupled look-back) for large inputs
+template<typename InputIterator, typename OutputIterator,
+		typename BinaryOp = std::plus<
+				typename std::iterator_traits<InputIterator>::value_type>>
+OutputIterator parallel_inclusive_scan_lookback(InputIterator first,
+		InputIterator last, OutputIterator d_first, size_t Nthreads = 2,
+		BinaryOp op = BinaryOp()) {
+	typedef typename std::iterator_traits<InputIterator>::value_type T;
+	return parallel_scan_lookback(first, last, d_first, (const T*) nullptr, op,
+			false, Nthreads);
+}
+
+// Exclusive prefix scan (single-pass, decoupled look-back) for large inputs
+template<typename InputIterator, typename OutputIterator, typename T,
+		typename BinaryOp = std::plus<T>>
+OutputIterator parallel_exclusive_scan_lookback(InputIterator first,
+		InputIterator last, OutputIterator d_first, T init, size_t Nthreads = 2,
+		BinaryOp op = BinaryOp()) {
+	return parallel_scan_lookback(first, last, d_first, &init, op, true,
+			Nthreads);
+}
+
+#endif /* PARALLEL_SCAN_H_ */
@@ -0,0 +1,176 @@
+/*
+ * parallel_summary.h
+ *
+ * Multithreaded single-pass summary statistics (sum, min, max, argmin, argmax,
+ * count, mean, variance)
+ *
+ */
+
+#ifndef PARALLEL_SUMMARY_H_
+#define PARALLEL_SUMMARY_H_
+
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <thread>
+#include "thread_pool.h"
+
+// number of elements per block of the summary kernel (a block stays in L1 cache
+// between the passes of the kernel)
+constexpr size_t kSummaryBlockSize = 2048;
+
+template<typename T>
+struct summary {
+	summary() :
+			sum(T { }), min(T { }), max(T { }), argmin(0), argmax(0), count(0), mean(
+					0.0), m2(0.0) {
+	}
+
+	// population variance
+	double variance() const {
+		return count ? m2 / count : 0.0;
+	}
+
+	// sample variance
+	double sample_variance() const {
+		return count > 1 ? m2 / (count - 1) : 0.0;
+	}
+
+	// Merges the summary of the elements that directly follow these ones
+	// (Chan et al. pairwise update of mean and sum of squared deviations)
+	void merge(const summary &rhs) {
+		if (!rhs.count)
+			return;
+		if (!count) {
+			*this = rhs;
+			return;
+		}
+		const size_t Ncount = count + rhs.count;
+		const double delta = rhs.mean - mean;
+		mean += delta * rhs.count / Ncount;
+		m2 += rhs.m2 + delta * delta * count / Ncount * rhs.count;
+		sum += rhs.sum;
+		if (rhs.min < min) {
+			min = rhs.min;
+			argmin = rhs.argmin;
+		}
+		if (max < rhs.max) {
+			max = rhs.max;
+			argmax = rhs.argmax;
+		}
+		count = Ncount;
+	}
+
+	T sum;
+	T min;
+	T max;
+	size_t argmin; // index of the first minimum
+	size_t argmax; // index of the first maximum
+	size_t count;
+	double mean;
+	double m2; // sum of squared deviations from the mean
+};
+
+// Summary of a single block (non-empty) starting at index offset: one pass for
+// sum/min/max, one for the squared deviations, then the first min/max positions
+template<typename Iterator, typename T>
+summary<T> summarize_block(Iterator first, size_t Nelements, size_t offset) {
+	T sum = first[0];
+	T min = first[0];
+	T max = first[0];
+	double dsum = first[0];
+	for (size_t i = 1; i < Nelements; ++i) {
+		const T value = first[i];
+		sum += value;
+		dsum += value;
+		min = value < min ? value : min;
+		max = max < value ? value : max;
+	}
+
+	const double mean = dsum / Nelements;
+	double m2 = 0.0;
+	for (size_t i = 0; i < Nelements; ++i) {
+		const double deviation = first[i] - mean;
+		m2 += deviation * deviation;
+	}
+
+	summary<T> result;
+	result.sum = sum;
+	result.min = min;
+	result.max = max;
+	result.argmin = offset + (std::find(first, first + Nelements, min) - first);
+	result.argmax = offset + (std::find(first, first + Nelements, max) - first);
+	result.count = Nelements;
+	result.mean = mean;
+	result.m2 = m2;
+	return result;
+}
+
+// Summary of [first + start, first + stop) block by block
+template<typename Iterator, typename T>
+summary<T> summarize_chunk(Iterator first, size_t start, size_t stop) {
+	summary<T> result;
+	for (size_t offset = start; offset < stop; offset += kSummaryBlockSize)
+		result.merge(
+				summarize_block<Iterator, T>(first + offset,
+						std::min(kSummaryBlockSize, stop - offset), offset));
+	return result;
+}
+
+// Computes sum, min, max, argmin, argmax, count, mean and variance of a range in
+// a single memory sweep. Requires random access iterators.
+template<typename Iterator,
+		typename T = typename std::iterator_traits<Iterator>::value_type>
+summary<T> parallel_summary(Iterator first, Iterator last, size_t Nthreads = 2) {
+
+	// number of elements
+	const size_t Nelements = std::distance(first, last);
+
+	if (!Nelements)
+		return summary<T>();
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+
+	// number of elements per chunk (whole blocks)
+	const size_t Nblocks = (Nelements + kSummaryBlockSize - 1)
+			/ kSummaryBlockSize;
+	if (Nthreads > Nblocks)
+		Nthreads = Nblocks;
+	const size_t Nel_per_chunk = (Nblocks + Nthreads - 1) / Nthreads
+			* kSummaryBlockSize;
+	const size_t Nchunks = (Nelements + Nel_per_chunk - 1) / Nel_per_chunk;
+
+	// start thread pool
+	thread_pool pool(Nchunks - 1);
+
+	// vector of futures
+	std::vector<std::future<summary<T>>> future_results(Nchunks - 1);
+
+	// all chunks except the last one
+	for (size_t chunkNo = 0; chunkNo < Nchunks - 1; ++chunkNo) {
+		const size_t start = chunkNo * Nel_per_chunk;
+		future_results[chunkNo] = pool.submit(
+				[first, start, Nel_per_chunk]() -> summary<T> {
+					return summarize_chunk<Iterator, T>(first, start,
+							start + Nel_per_chunk);
+				});
+	}
+
+	// final chunk
+	const summary<T> last_result = summarize_chunk<Iterator, T>(first,
+			(Nchunks - 1) * Nel_per_chunk, Nelements);
+
+	// merge chunks in order
+	summary<T> result;
+	for (size_t chunkNo = 0; chunkNo < Nchunks - 1; ++chunkNo)
+		result.merge(future_results[chunkNo].get());
+	result.merge(last_result);
+	return result;
+}
+
+#endif /* PARALLEL_SUMMARY_H_ */
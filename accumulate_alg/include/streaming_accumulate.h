@@ -0,0 +1,140 @@
+/*
+ * streaming_accumulate.h
+ *
+ * Multithreaded accumulate algorithm over a stream of values ingested in
+ * fixed-size, double-buffered chunks
+ *
+ */
+
+#ifndef STREAMING_ACCUMULATE_H_
+#define STREAMING_ACCUMULATE_H_
+
+#include <vector>
+#include <istream>
+#include <algorithm>
+#include <future>
+#include <chrono>
+#include <thread>
+#include <type_traits>
+#include <system_error>
+#include <stdexcept>
+#include <cerrno>
+#include <unistd.h>
+#include "thread_pool.h"
+#include "parallel_accumulate.h"
+
+// default number of values per ingestion buffer
+constexpr size_t kStreamBufferSize = 1 << 20;
+
+// Accumulates a stream of values. The producer is called as
+// produce(T *buffer, size_t capacity) and returns the number of values it wrote
+// (0 at the end of the stream). Two buffers are used: while the pool reduces
+// one of them, the calling thread fills the other one, so the memory used is
+// 2 * buffer_size values regardless of the length of the stream.
+template<typename T, typename Producer>
+T streaming_accumulate(Producer produce, T init, size_t Nthreads = 2,
+		size_t buffer_size = kStreamBufferSize) {
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+	if (!buffer_size)
+		buffer_size = 1;
+
+	// ingestion buffers (declared before the pool, which must stop first)
+	std::vector<T> buffers[2] = { std::vector<T>(buffer_size), std::vector<T>(
+			buffer_size) };
+	size_t current = 0;
+
+	// start thread pool (the calling thread is busy filling the buffers)
+	thread_pool pool(Nthreads - 1);
+	const size_t Nchunks = std::max(Nthreads - 1, (size_t) 1);
+
+	// vector of futures (chunks of the buffer being reduced)
+	std::vector<std::future<T>> future_results(Nchunks);
+
+	T result = init;
+	size_t Nelements = produce(buffers[current].data(), buffer_size);
+	while (Nelements) {
+
+		// hand off the current buffer
+		const size_t Nel_per_chunk = (Nelements + Nchunks - 1) / Nchunks;
+		const T *first = buffers[current].data();
+		for (size_t chunkNo = 0; chunkNo < Nchunks; ++chunkNo) {
+			const T *start = first + std::min(chunkNo * Nel_per_chunk, Nelements);
+			const T *stop = first
+					+ std::min((chunkNo + 1) * Nel_per_chunk, Nelements);
+			future_results[chunkNo] = pool.submit([start, stop]() -> T {
+				return accumulate_chunk<const T*, T>(start, stop);
+			});
+		}
+
+		// fill the other buffer meanwhile
+		current = 1 - current;
+		const size_t Nnext = produce(buffers[current].data(), buffer_size);
+
+		// sum over chunks, help the pool while waiting
+		for (auto &future_result : future_results) {
+			while (future_result.wait_for(std::chrono::seconds(0))
+					!= std::future_status::ready)
+				pool.run_pending_task();
+			result += future_result.get();
+		}
+		Nelements = Nnext;
+	}
+	return result;
+}
+
+// Accumulates packed values of type T read from a binary input stream.
+// Throws std::runtime_error if the stream ends in the middle of a value.
+template<typename T>
+T streaming_accumulate_stream(std::istream &in, T init, size_t Nthreads = 2,
+		size_t buffer_size = kStreamBufferSize) {
+	static_assert(std::is_trivially_copyable<T>::value,
+			"packed values must be trivially copyable");
+	return streaming_accumulate(
+			[&in](T *buffer, size_t capacity) -> size_t {
+				in.read(reinterpret_cast<char*>(buffer), capacity * sizeof(T));
+				const size_t Nbytes = in.gcount();
+				if (Nbytes % sizeof(T))
+					throw std::runtime_error(
+							"stream ends in the middle of a value");
+				return Nbytes / sizeof(T);
+			}, init, Nthreads, buffer_size);
+}
+
+// Accumulates packed values of type T read from a file descriptor (file, pipe,
+// socket). Throws std::system_error on read errors and std::runtime_error if the
+// input ends in the middle of a value.
+template<typename T>
+T streaming_accumulate_fd(int fd, T init, size_t Nthreads = 2,
+		size_t buffer_size = kStreamBufferSize) {
+	static_assert(std::is_trivially_copyable<T>::value,
+			"packed values must be trivially copyable");
+	return streaming_accumulate(
+			[fd](T *buffer, size_t capacity) -> size_t {
+				char *data = reinterpret_cast<char*>(buffer);
+				const size_t Nbytes_max = capacity * sizeof(T);
+				size_t Nbytes = 0;
+				while (Nbytes < Nbytes_max) {
+					const ssize_t Nread = ::read(fd, data + Nbytes,
+							Nbytes_max - Nbytes);
+					if (Nread < 0) {
+						if (errno == EINTR)
+							continue;
+						throw std::system_error(errno, std::generic_category(),
+								"read");
+					}
+					if (!Nread)
+						break;
+					Nbytes += Nread;
+				}
+				if (Nbytes % sizeof(T))
+					throw std::runtime_error(
+							"input ends in the middle of a value");
+				return Nbytes / sizeof(T);
+			}, init, Nthreads, buffer_size);
+}
+
+#endif /* STREAMING_ACCUMULATE_H_ */
@@ -2,6 +2,7 @@
  * thread_pool.h
  *
  * Interruptible thread pool (workers can steal tasks from the main thread and from each other)
+ * with compile-time container policies and a run-time victim selection policy
  *
  */
 
@@ -11,28 +12,97 @@
 #include <memory>
 #include <utility>
 #include <vector>
+#include <list>
 #include <future>
 #include <type_traits>
 #include <exception>
 #include <thread>
 #include <atomic>
+#include <algorithm>
+#include <cstdint>
 #include "function_wrapper.h"
 #include "threads_guard.h"
 #include "threadsafe_queue1.h"
 #include "threadsafe_queue2.h"
 #include "threadsafe_queue3.h"
 #include "threadsafe_queue4.h"
+#include "threadsafe_queue5.h"
+#include "threadsafe_queue6.h"
+#include "threadsafe_queue7.h"
 #include "threadsafe_stack1.h"
 #include "threadsafe_stack2.h"
 #include "threadsafe_stack3.h"
+#include "threadsafe_stack4.h"
+#include "threadsafe_stack5.h"
+#include "threadsafe_stack6.h"
+#include "epoch_reclamation.h"
+#include "cpu_topology.h"
 
+// default container of the main thread and of the workers
 template<typename T>
 using ThreadSafeContainerType = ThreadSafeQueue1<T>;
 
-class thread_pool {
+// Order in which an idle worker visits the containers of the other workers
+enum class victim_selection {
+	sequential, // worker_index + 1, worker_index + 2, .. (default)
+	random, // same, but from a random victim on every attempt
+	// workers sharing an L2 cache, then an L3 cache, then the others, each
+	// group from a random victim on (pins the workers to cpus)
+	topology
+};
+
+struct steal_policy {
+	steal_policy(victim_selection _selection = victim_selection::sequential,
+			size_t _Nrounds = 1, bool _steal_half = true) :
+			selection(_selection), Nrounds(_Nrounds), steal_half(_steal_half) {
+	}
+	victim_selection selection;
+	// sweeps over the victims before an idle worker yields (0 disables
+	// stealing from the other workers)
+	size_t Nrounds;
+	// take up to half of the tasks of a victim at once (containers with
+	// tryStealHalf and pushBatch only, one task otherwise)
+	bool steal_half;
+};
+
+// steals of all workers since the pool was created
+struct steal_statistics {
+	size_t Nsteals; // successful steals
+	size_t Ntasks; // tasks taken by them
+	size_t Nmax_batch; // largest number of tasks taken at once
+};
+
+// containers that may refuse an element (bounded, e.g. ThreadSafeQueue5)
+template<typename Container, typename Element, typename = void>
+struct has_try_push: std::false_type {
+};
+template<typename Container, typename Element>
+struct has_try_push<Container, Element,
+		decltype(void(
+				std::declval<Container&>().tryPush(std::declval<Element&&>())))> : std::true_type {
+};
+
+// containers that hand over and take back batches of their list nodes
+// (tryStealHalf and pushBatch, e.g. ThreadSafeQueue1 or ThreadSafeStack1)
+template<typename Container, typename Batch, typename = void>
+struct has_steal_half: std::false_type {
+};
+template<typename Container, typename Batch>
+struct has_steal_half<Container, Batch,
+		decltype(void(std::declval<Container&>().tryStealHalf(std::declval<Batch&>())),
+				void(std::declval<Container&>().pushBatch(std::declval<Batch&>())))> : std::true_type {
+};
+
+// MasterContainer holds the tasks submitted by the main thread and
+// WorkerContainer those submitted by each worker (any container template
+// with push and tryPop, e.g. ThreadSafeQueue1 or ThreadSafeStack3)
+template<template<typename > class MasterContainer = ThreadSafeContainerType,
+		template<typename > class WorkerContainer = ThreadSafeContainerType>
+class basic_thread_pool {
 private:
 	typedef function_wrapper task_type;
 	typedef std::unique_ptr<task_type> task_type_ptr;
+	typedef std::list<task_type_ptr> task_batch;
 
 	class atomic_wrapper {
 	public:
@@ -53,6 +123,17 @@ private:
 		std::atomic<bool> flag;
 	};
 
+	// steals of a worker, on its own cache line
+	struct steal_counter {
+		steal_counter() :
+				Nsteals(0), Ntasks(0), Nmax_batch(0) {
+		}
+		std::atomic<size_t> Nsteals;
+		std::atomic<size_t> Ntasks;
+		std::atomic<size_t> Nmax_batch;
+		char padding[64 - 3 * sizeof(std::atomic<size_t>)];
+	};
+
 	class thread_interrupted: public std::exception {
 	public:
 		const char* what(void) const noexcept (true) override {
@@ -72,31 +153,65 @@ private:
 		return master_container.tryPop();
 	}
 	task_type_ptr pop_task_from_other_thread_stack();
+	void assign_victims(const std::vector<int> &workers_cpus);
+	void count_steal(size_t Ntasks);
+	task_type_ptr steal_task(WorkerContainer<task_type> &victim);
+	task_type_ptr steal_half(WorkerContainer<task_type> &victim,
+			std::true_type);
+	task_type_ptr steal_half(WorkerContainer<task_type> &victim,
+			std::false_type);
+	task_type_ptr steal_one(WorkerContainer<task_type> &victim);
+	template<typename Container>
+	static bool push_task(Container &container, task_type &task);
+	template<typename Container>
+	static bool push_task(Container &container, task_type &task,
+			std::true_type);
+	template<typename Container>
+	static bool push_task(Container &container, task_type &task,
+			std::false_type);
+	static size_t random_index(size_t size);
 public:
-	thread_pool(size_t _Nthreads = 1);
-	~thread_pool();
-	thread_pool(const thread_pool&) = delete;
-	thread_pool& operator=(const thread_pool&) = delete;
-	thread_pool(thread_pool&&) = delete;
-	thread_pool& operator=(thread_pool&&) = delete;
+	basic_thread_pool(size_t _Nthreads = 1,
+			steal_policy _policy = steal_policy());
+	~basic_thread_pool();
+	basic_thread_pool(const basic_thread_pool&) = delete;
+	basic_thread_pool& operator=(const basic_thread_pool&) = delete;
+	basic_thread_pool(basic_thread_pool&&) = delete;
+	basic_thread_pool& operator=(basic_thread_pool&&) = delete;
 
 	template<typename FunctionType>
 	std::future<typename std::result_of<FunctionType()>::type> submit(
 			FunctionType f);
 	void run_pending_task();
 	void kill_worker(size_t index);
+	steal_statistics statistics() const;
 private:
-	ThreadSafeContainerType<task_type> master_container;
-	std::vector<std::unique_ptr<ThreadSafeContainerType<task_type>>> workers_containers;
+	MasterContainer<task_type> master_container;
+	std::vector<std::unique_ptr<WorkerContainer<task_type>>> workers_containers;
 	static thread_local size_t worker_index;
+	steal_policy policy;
+	// victims of every worker, in groups visited one after the other
+	std::vector<std::vector<std::vector<size_t>>> victims;
+	// tasks of the last steal of every worker
+	std::vector<task_batch> steal_batches;
+	std::vector<steal_counter> steal_counters;
 	std::vector<atomic_wrapper> flags;
 	std::vector<std::thread> threads;
 	ThreadsGuard<std::thread> threads_guard;
 };
-thread_local size_t thread_pool::worker_index = 111; // index of main thread
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+thread_local size_t basic_thread_pool<MasterContainer, WorkerContainer>::worker_index =
+		111; // index of main thread
+
+typedef basic_thread_pool<> thread_pool;
 
-thread_pool::thread_pool(size_t _Nthreads) :
-		flags(_Nthreads), threads_guard(threads) {
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+basic_thread_pool<MasterContainer, WorkerContainer>::basic_thread_pool(
+		size_t _Nthreads, steal_policy _policy) :
+		policy(_policy), steal_batches(_Nthreads), steal_counters(_Nthreads), flags(
+				_Nthreads), threads_guard(threads) {
 	// max number of hardware threads
 	const size_t NthreadsMax = std::thread::hardware_concurrency();
 	if (_Nthreads > NthreadsMax)
@@ -105,67 +220,257 @@ thread_pool::thread_pool(size_t _Nthreads) :
 	workers_containers.reserve(_Nthreads);
 	threads.reserve(_Nthreads);
 	try {
-		for (size_t i = 0; i < _Nthreads; ++i) {
+		for (size_t i = 0; i < _Nthreads; ++i)
 			workers_containers.emplace_back(
-					new ThreadSafeContainerType<task_type>());
-			threads.emplace_back(&thread_pool::worker_thread, this, i);
+					new WorkerContainer<task_type>());
+		// workers on the cpus after the first one, which is left to the main
+		// thread
+		std::vector<int> workers_cpus;
+		if (policy.selection == victim_selection::topology) {
+			const std::vector<int> &cpus = system_topology().cpus();
+			for (size_t i = 0; i < _Nthreads; ++i)
+				workers_cpus.push_back(cpus[(i + 1) % cpus.size()]);
+		}
+		assign_victims(workers_cpus);
+		for (size_t i = 0; i < _Nthreads; ++i) {
+			threads.emplace_back(&basic_thread_pool::worker_thread, this, i);
+			if (!workers_cpus.empty())
+				cpu_topology::pin(threads[i].native_handle(), workers_cpus[i]);
 		}
 	} catch (...) {
 		// swallow this exception
 	}
 }
 
-thread_pool::~thread_pool() {
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+basic_thread_pool<MasterContainer, WorkerContainer>::~basic_thread_pool() {
 	for (size_t i = 0; i < threads.size(); ++i)
 		kill_worker(i);
 }
 
-void thread_pool::interruption_point() {
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+void basic_thread_pool<MasterContainer, WorkerContainer>::interruption_point() {
 	if (flags[worker_index].status_flag())
 		throw thread_interrupted();
 }
 
-void thread_pool::worker_thread(size_t index) {
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+void basic_thread_pool<MasterContainer, WorkerContainer>::worker_thread(
+		size_t index) {
 	worker_index = index;
 	while (true) {
 		try {
 			interruption_point();
 			run_pending_task();
+			// no container references are held between tasks (only workers
+			// whose tasks used the epoch domain take part in it)
+			epoch_domain::quiescent_state_if_registered();
 		} catch (const thread_interrupted&) {
 			break; // stop the worker
 		}
 	}
 }
 
-thread_pool::task_type_ptr thread_pool::pop_task_from_other_thread_stack() {
-	for (size_t i = 0; i < workers_containers.size(); ++i) {
-		const size_t index = (worker_index + i + 1) % workers_containers.size();
-		if (task_type_ptr task = workers_containers[index]->tryPop())
-			return task;
+// groups the other workers by their distance from every worker (a single
+// group without the cpus of the workers)
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+void basic_thread_pool<MasterContainer, WorkerContainer>::assign_victims(
+		const std::vector<int> &workers_cpus) {
+	const size_t Nworkers = workers_containers.size();
+	victims.assign(Nworkers, std::vector<std::vector<size_t>>());
+	for (size_t worker = 0; worker < Nworkers; ++worker) {
+		std::vector<std::vector<size_t>> groups(
+				workers_cpus.empty() ? 1 : kRemote + 1);
+		for (size_t i = 1; i < Nworkers; ++i) {
+			const size_t victim = (worker + i) % Nworkers;
+			const size_t group =
+					workers_cpus.empty() ?
+							0 :
+							system_topology().distance(workers_cpus[worker],
+									workers_cpus[victim]);
+			groups[group].push_back(victim);
+		}
+		for (auto &group : groups)
+			if (!group.empty())
+				victims[worker].push_back(std::move(group));
 	}
+}
+
+// xorshift generator per thread, seeded by the address of its state
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+size_t basic_thread_pool<MasterContainer, WorkerContainer>::random_index(
+		size_t size) {
+	static thread_local std::uint32_t state = 0;
+	if (!state)
+		state = std::uint32_t(reinterpret_cast<std::uintptr_t>(&state) >> 4)
+				| 1;
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state % size;
+}
+
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+typename basic_thread_pool<MasterContainer, WorkerContainer>::task_type_ptr basic_thread_pool<
+		MasterContainer, WorkerContainer>::pop_task_from_other_thread_stack() {
+	const std::vector<std::vector<size_t>> &groups = victims[worker_index];
+	for (size_t round = 0; round < policy.Nrounds; ++round)
+		for (const auto &group : groups) {
+			const size_t first =
+					policy.selection == victim_selection::sequential ?
+							0 : random_index(group.size());
+			for (size_t i = 0; i < group.size(); ++i) {
+				const size_t index = group[(first + i) % group.size()];
+				if (task_type_ptr task = steal_task(*workers_containers[index]))
+					return task;
+			}
+		}
 	return task_type_ptr();
 }
 
-void thread_pool::kill_worker(size_t index) {
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+typename basic_thread_pool<MasterContainer, WorkerContainer>::task_type_ptr basic_thread_pool<
+		MasterContainer, WorkerContainer>::steal_task(
+		WorkerContainer<task_type> &victim) {
+	if (policy.steal_half)
+		return steal_half(victim,
+				has_steal_half<WorkerContainer<task_type>, task_batch>());
+	return steal_one(victim);
+}
+
+// takes up to half of the victim's tasks and runs the oldest one; the list
+// nodes of the others move to the container of the thief in their original
+// order, without reallocating them
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+typename basic_thread_pool<MasterContainer, WorkerContainer>::task_type_ptr basic_thread_pool<
+		MasterContainer, WorkerContainer>::steal_half(
+		WorkerContainer<task_type> &victim, std::true_type) {
+	task_batch &batch = steal_batches[worker_index];
+	const size_t Nstolen = victim.tryStealHalf(batch);
+	if (!Nstolen)
+		return task_type_ptr();
+	count_steal(Nstolen);
+	task_type_ptr task = std::move(batch.front());
+	batch.pop_front();
+	if (!batch.empty())
+		workers_containers[worker_index]->pushBatch(batch);
+	return task;
+}
+
+// containers without batch steals
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+typename basic_thread_pool<MasterContainer, WorkerContainer>::task_type_ptr basic_thread_pool<
+		MasterContainer, WorkerContainer>::steal_half(
+		WorkerContainer<task_type> &victim, std::false_type) {
+	return steal_one(victim);
+}
+
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+typename basic_thread_pool<MasterContainer, WorkerContainer>::task_type_ptr basic_thread_pool<
+		MasterContainer, WorkerContainer>::steal_one(
+		WorkerContainer<task_type> &victim) {
+	task_type_ptr task = victim.tryPop();
+	if (task)
+		count_steal(1);
+	return task;
+}
+
+// only the worker itself updates its counter
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+void basic_thread_pool<MasterContainer, WorkerContainer>::count_steal(
+		size_t Ntasks) {
+	steal_counter &counter = steal_counters[worker_index];
+	counter.Nsteals.store(counter.Nsteals.load(std::memory_order_relaxed) + 1,
+			std::memory_order_relaxed);
+	counter.Ntasks.store(
+			counter.Ntasks.load(std::memory_order_relaxed) + Ntasks,
+			std::memory_order_relaxed);
+	if (Ntasks > counter.Nmax_batch.load(std::memory_order_relaxed))
+		counter.Nmax_batch.store(Ntasks, std::memory_order_relaxed);
+}
+
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+steal_statistics basic_thread_pool<MasterContainer, WorkerContainer>::statistics() const {
+	steal_statistics total = { 0, 0, 0 };
+	for (const steal_counter &counter : steal_counters) {
+		total.Nsteals += counter.Nsteals.load(std::memory_order_relaxed);
+		total.Ntasks += counter.Ntasks.load(std::memory_order_relaxed);
+		total.Nmax_batch = std::max(total.Nmax_batch,
+				counter.Nmax_batch.load(std::memory_order_relaxed));
+	}
+	return total;
+}
+
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+void basic_thread_pool<MasterContainer, WorkerContainer>::kill_worker(
+		size_t index) {
 	interrupt_worker(index);
 	if (threads[index].joinable())
 		threads[index].join();
 }
 
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
 template<typename FunctionType>
-std::future<typename std::result_of<FunctionType()>::type> thread_pool::submit(
-		FunctionType f) {
+std::future<typename std::result_of<FunctionType()>::type> basic_thread_pool<
+		MasterContainer, WorkerContainer>::submit(FunctionType f) {
 	typedef typename std::result_of<FunctionType()>::type result_type;
 	std::packaged_task<result_type()> task(std::move(f));
 	std::future<result_type> res(task.get_future());
-	if (worker_index == 111)
-		master_container.push(std::move(task));
-	else
-		workers_containers[worker_index]->push(std::move(task));
+	task_type wrapped(std::move(task));
+	// a worker whose bounded container is full hands the task to the main
+	// thread's container; the task runs right here if that is full as well
+	if (worker_index == 111) {
+		if (!push_task(master_container, wrapped))
+			wrapped();
+	} else if (!push_task(*workers_containers[worker_index], wrapped)
+			&& !push_task(master_container, wrapped))
+		wrapped();
 	return res;
 }
 
-void thread_pool::run_pending_task() {
+// pushes the task unless the container is full (the task is left untouched)
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+template<typename Container>
+bool basic_thread_pool<MasterContainer, WorkerContainer>::push_task(
+		Container &container, task_type &task) {
+	return push_task(container, task, has_try_push<Container, task_type>());
+}
+
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+template<typename Container>
+bool basic_thread_pool<MasterContainer, WorkerContainer>::push_task(
+		Container &container, task_type &task, std::true_type) {
+	return container.tryPush(std::move(task));
+}
+
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+template<typename Container>
+bool basic_thread_pool<MasterContainer, WorkerContainer>::push_task(
+		Container &container, task_type &task, std::false_type) {
+	container.push(std::move(task));
+	return true;
+}
+
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+void basic_thread_pool<MasterContainer, WorkerContainer>::run_pending_task() {
 	if (worker_index == 111) {
 		if (task_type_ptr task = pop_task_from_pool_stack())
 			return task->operator()();
@@ -184,4 +489,3 @@ void thread_pool::run_pending_task() {
 }
 
 #endif /* THREAD_POOL_H_ */
-
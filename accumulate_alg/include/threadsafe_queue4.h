@@ -1,25 +1,31 @@
 /*
  * threadsafe_queue4.h
  *
- * Lock-free thread-safe unbounded queue implemented using a singly-linked list,
- * and atomic operations with the relaxed memory models
+ * Lock-free thread-safe unbounded queue implemented using a singly-linked list
+ * with a dummy node (Michael-Scott queue), and atomic operations with the
+ * relaxed memory models. The front, back and next pointers carry a 16-bit tag
+ * in their upper bits that is bumped on every update, so a stale
+ * compare-exchange fails (ABA). Popped nodes go to an internal free list and
+ * are only deleted with the queue, so reading a node that has just been
+ * popped by another thread is always safe.
  *
  */
 
 #ifndef THREADSAFE_QUEUE4_H_
 #define THREADSAFE_QUEUE4_H_
 
-#include <memory> // std::shared_ptr, std::unique_ptr
-#include <utility> // std::move
-#include <atomic> // std::atomic, atomic_exchange, atomic_load
+#include <memory> // std::unique_ptr
+#include <utility> // std::move, std::forward
+#include <atomic> // std::atomic
+#include <cstdint> // std::uint64_t, std::uintptr_t
 #include <exception> // std::exception
 
 template<typename Element>
 class ThreadSafeQueue4 {
-	typedef std::shared_ptr<Element> ElementPtr;
 	typedef std::unique_ptr<Element> ElementUPtr;
-	class Node; // forward declaration
-	typedef std::shared_ptr<Node> NodePtr;
+	typedef std::uint64_t TaggedPtr; // 48-bit node pointer and 16-bit tag
+	static_assert(sizeof(void*) == sizeof(TaggedPtr),
+			"tagged pointers need 64-bit addresses");
 
 	struct EmptyQueue: public std::exception {
 		virtual const char* what() const noexcept (true) override {
@@ -29,19 +35,23 @@ class ThreadSafeQueue4 {
 
 	struct Node {
 		Node() :
-				m_data(nullptr), next(nullptr) {
-		}
-		Node(const Element &element) :
-				m_data(std::make_unique<Element>(element)), next(nullptr) {
-		}
-		Node(Element &&element) :
-				m_data(std::make_unique<Element>(std::move(element))), next(
-						nullptr) {
+				m_data(nullptr), next(0) {
 		}
 		~Node() = default;
-		ElementUPtr m_data;
-		NodePtr next;
+		std::atomic<Element*> m_data;
+		std::atomic<TaggedPtr> next; // also links the free list
 	};
+
+	static constexpr unsigned kTagShift = 48;
+	static Node* pointer(TaggedPtr tagged) {
+		return reinterpret_cast<Node*>(tagged
+				& ((TaggedPtr(1) << kTagShift) - 1));
+	}
+	// node tagged one past the tag of the value it replaces
+	static TaggedPtr successor(TaggedPtr replaced, Node *node) {
+		return reinterpret_cast<std::uintptr_t>(node)
+				| (((replaced >> kTagShift) + 1) << kTagShift);
+	}
 public:
 	ThreadSafeQueue4();
 	~ThreadSafeQueue4();
@@ -57,67 +67,151 @@ public:
 	void emplace(Ts &&... pars);
 	std::unique_ptr<Element> tryPop();
 private:
-	std::atomic<Node*> m_label_back;
-	NodePtr m_label_front;
+	void pushElement(ElementUPtr element);
+	Node* allocateNode();
+	void freeNode(Node *node);
+
+	std::atomic<TaggedPtr> m_label_front; // dummy node
+	char m_padding0[64 - sizeof(std::atomic<TaggedPtr>)];
+	std::atomic<TaggedPtr> m_label_back;
+	char m_padding1[64 - sizeof(std::atomic<TaggedPtr>)];
+	std::atomic<TaggedPtr> m_free_nodes;
 };
 
 template<typename Element>
 ThreadSafeQueue4<Element>::ThreadSafeQueue4() :
-		m_label_back(new Node()), m_label_front(
-				m_label_back.load(std::memory_order_release)) {
+		m_label_front(reinterpret_cast<std::uintptr_t>(new Node())), m_label_back(
+				m_label_front.load(std::memory_order_relaxed)), m_free_nodes(0) {
 }
 
 template<typename Element>
 ThreadSafeQueue4<Element>::~ThreadSafeQueue4() {
+	// the dummy node's data has already been popped
+	Node *node = pointer(m_label_front.load(std::memory_order_relaxed));
+	Node *next = pointer(node->next.load(std::memory_order_relaxed));
+	delete node;
+	while (next) {
+		node = next;
+		next = pointer(node->next.load(std::memory_order_relaxed));
+		delete node->m_data.load(std::memory_order_relaxed);
+		delete node;
+	}
+	node = pointer(m_free_nodes.load(std::memory_order_relaxed));
+	while (node) {
+		next = pointer(node->next.load(std::memory_order_relaxed));
+		delete node;
+		node = next;
+	}
+}
+
+template<typename Element>
+typename ThreadSafeQueue4<Element>::Node* ThreadSafeQueue4<Element>::allocateNode() {
+	TaggedPtr head = m_free_nodes.load(std::memory_order_acquire);
+	while (pointer(head)) {
+		// a node popped by another thread meanwhile is still readable, and the
+		// tag makes the exchange fail
+		const TaggedPtr next = pointer(head)->next.load(
+				std::memory_order_relaxed);
+		if (m_free_nodes.compare_exchange_weak(head,
+				successor(head, pointer(next)), std::memory_order_acquire,
+				std::memory_order_acquire))
+			return pointer(head);
+	}
+	return new Node();
+}
+
+template<typename Element>
+void ThreadSafeQueue4<Element>::freeNode(Node *node) {
+	TaggedPtr head = m_free_nodes.load(std::memory_order_relaxed);
+	do {
+		node->next.store(
+				successor(node->next.load(std::memory_order_relaxed),
+						pointer(head)), std::memory_order_relaxed);
+	} while (!m_free_nodes.compare_exchange_weak(head, successor(head, node),
+			std::memory_order_release, std::memory_order_relaxed));
 }
 
 template<typename Element>
 bool ThreadSafeQueue4<Element>::empty() const {
-	return !std::atomic_load_explicit(&m_label_front, std::memory_order_release)->next;
+	return !pointer(
+			pointer(m_label_front.load(std::memory_order_acquire))->next.load(
+					std::memory_order_acquire));
+}
+
+template<typename Element>
+void ThreadSafeQueue4<Element>::pushElement(ElementUPtr element) {
+	Node *new_node = allocateNode();
+	new_node->m_data.store(element.release(), std::memory_order_relaxed);
+	new_node->next.store(
+			successor(new_node->next.load(std::memory_order_relaxed), nullptr),
+			std::memory_order_relaxed);
+	TaggedPtr back;
+	while (true) {
+		back = m_label_back.load(std::memory_order_acquire);
+		TaggedPtr next = pointer(back)->next.load(std::memory_order_acquire);
+		if (back != m_label_back.load(std::memory_order_acquire))
+			continue;
+		if (pointer(next)) {
+			// help a lagging push to swing the back label
+			m_label_back.compare_exchange_weak(back,
+					successor(back, pointer(next)), std::memory_order_release,
+					std::memory_order_relaxed);
+			continue;
+		}
+		// the node is fully built before it becomes reachable
+		if (pointer(back)->next.compare_exchange_weak(next,
+				successor(next, new_node), std::memory_order_release,
+				std::memory_order_relaxed))
+			break;
+	}
+	m_label_back.compare_exchange_strong(back, successor(back, new_node),
+			std::memory_order_release, std::memory_order_relaxed);
 }
 
 template<typename Element>
 void ThreadSafeQueue4<Element>::push(const Element &element) {
-	ElementUPtr new_element(std::make_unique<Element>(element));
-	NodePtr new_node(std::make_shared<Node>());
-	Node *old_back = m_label_back.exchange(new_node.get(),
-			std::memory_order_release);
-	old_back->m_data = std::move(new_element);
-	old_back->next = std::move(new_node);
+	pushElement(std::make_unique<Element>(element));
 }
 
 template<typename Element>
 void ThreadSafeQueue4<Element>::push(Element &&element) {
-	ElementUPtr new_element(std::make_unique<Element>(std::move(element)));
-	NodePtr new_node(std::make_shared<Node>());
-	Node *old_back = m_label_back.exchange(new_node.get(),
-			std::memory_order_release);
-	old_back->m_data = std::move(new_element);
-	old_back->next = std::move(new_node);
+	pushElement(std::make_unique<Element>(std::move(element)));
 }
 
 template<typename Element>
 template<typename ...Ts>
 void ThreadSafeQueue4<Element>::emplace(Ts &&... pars) {
-	ElementUPtr new_element(
-			std::make_unique<Element>(std::forward<Ts>(pars)...));
-	NodePtr new_node(std::make_shared<Node>());
-	Node *old_back = m_label_back.exchange(new_node.get(),
-			std::memory_order_release);
-	old_back->m_data = std::move(new_element);
-	old_back->next = std::move(new_node);
+	pushElement(std::make_unique<Element>(std::forward<Ts>(pars)...));
 }
 
 template<typename Element>
 std::unique_ptr<Element> ThreadSafeQueue4<Element>::tryPop() {
-	NodePtr front_node(std::atomic_load(&m_label_front));
-	while (front_node->next
-			&& !std::atomic_compare_exchange_weak_explicit(&m_label_front,
-					&front_node, front_node->next, std::memory_order_release,
-					std::memory_order_release))
-		;
-	return front_node->next ?
-			std::move(front_node->m_data) : std::unique_ptr<Element>(nullptr);
+	while (true) {
+		TaggedPtr front = m_label_front.load(std::memory_order_acquire);
+		TaggedPtr back = m_label_back.load(std::memory_order_acquire);
+		TaggedPtr next = pointer(front)->next.load(std::memory_order_acquire);
+		if (front != m_label_front.load(std::memory_order_acquire))
+			continue;
+		if (!pointer(next))
+			return std::unique_ptr<Element>(nullptr);
+		if (pointer(front) == pointer(back)) {
+			// help a lagging push before the back label falls behind the front
+			m_label_back.compare_exchange_weak(back,
+					successor(back, pointer(next)), std::memory_order_release,
+					std::memory_order_relaxed);
+			continue;
+		}
+		// read the data before the exchange: once it succeeds, next is the new
+		// dummy node and may be popped and reused by another thread; the data
+		// belongs to the thread whose exchange succeeds
+		Element *data = pointer(next)->m_data.load(std::memory_order_relaxed);
+		if (m_label_front.compare_exchange_weak(front,
+				successor(front, pointer(next)), std::memory_order_acq_rel,
+				std::memory_order_relaxed)) {
+			freeNode(pointer(front));
+			return ElementUPtr(data);
+		}
+	}
 }
 
 #endif /* THREADSAFE_QUEUE4_H_ */
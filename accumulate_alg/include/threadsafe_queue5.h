@@ -0,0 +1,252 @@
+/*
+ * threadsafe_queue5.h
+ *
+ * Lock-free thread-safe bounded queue implemented using a ring buffer of slots
+ * with per-slot sequence numbers (multi-producer multi-consumer, D. Vyukov),
+ * and atomic operations with the relaxed memory models
+ *
+ */
+
+#ifndef THREADSAFE_QUEUE5_H_
+#define THREADSAFE_QUEUE5_H_
+
+#include <memory> // std::unique_ptr
+#include <utility> // std::move, std::forward
+#include <atomic> // std::atomic
+#include <type_traits> // std::aligned_storage, std::is_nothrow_move_constructible
+#include <thread> // std::this_thread::yield
+#include <cstdint> // intptr_t
+#include <exception> // std::exception
+
+template<typename Element>
+class ThreadSafeQueue5 {
+	// nothing may throw between claiming a slot and publishing / releasing it,
+	// otherwise no later position gets past the slot
+	static_assert(std::is_nothrow_move_constructible<Element>::value,
+			"ThreadSafeQueue5 requires a nothrow move constructible element");
+	typedef std::unique_ptr<Element> ElementPtr;
+
+	struct EmptyQueue: public std::exception {
+		virtual const char* what() const noexcept (true) override {
+			return "Empty Queue";
+		}
+	};
+
+	// slot of the ring buffer: sequence == position for a free slot of the
+	// current lap, position + 1 for a full one
+	struct Slot {
+		std::atomic<size_t> sequence;
+		typename std::aligned_storage<sizeof(Element), alignof(Element)>::type m_data;
+	};
+public:
+	// capacity is rounded up to a power of two
+	ThreadSafeQueue5(size_t capacity = 1 << 16);
+	~ThreadSafeQueue5();
+	ThreadSafeQueue5(const ThreadSafeQueue5&) = delete;
+	ThreadSafeQueue5& operator=(const ThreadSafeQueue5&) = delete;
+	ThreadSafeQueue5(ThreadSafeQueue5&&) = delete;
+	ThreadSafeQueue5& operator=(ThreadSafeQueue5&&) = delete;
+
+	bool empty() const;
+	size_t size() const;
+	size_t capacity() const;
+	// push and emplace spin (yielding) while the queue is full
+	void push(const Element &element);
+	void push(Element &&element);
+	template<typename ...Ts>
+	void emplace(Ts &&... pars);
+	// never allocate, false if the queue is full / empty (tryPush leaves the
+	// element untouched then, tryEmplace has already consumed the arguments)
+	bool tryPush(const Element &element);
+	bool tryPush(Element &&element);
+	template<typename ...Ts>
+	bool tryEmplace(Ts &&... pars);
+	bool tryPop(Element &element);
+	// allocates the returned element (thread_pool container interface)
+	ElementPtr tryPop();
+private:
+	// moves the element into a slot, nothing to move from if the queue is full
+	bool tryMoveIn(Element &element) noexcept;
+	Slot* claimPushSlot(size_t &position);
+	Slot* claimPopSlot(size_t &position);
+	void releasePopSlot(Slot *slot, size_t position);
+
+	// head and tail on their own cache lines (padding rather than alignas, so
+	// the pool can allocate the queue with plain new)
+	const size_t m_mask;
+	std::unique_ptr<Slot[]> m_slots;
+	char m_padding0[64];
+	std::atomic<size_t> m_head;
+	char m_padding1[64 - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> m_tail;
+	char m_padding2[64 - sizeof(std::atomic<size_t>)];
+};
+
+// smallest power of two >= capacity (at least 2)
+inline size_t ring_buffer_capacity(size_t capacity) {
+	size_t rounded = 2;
+	while (rounded < capacity)
+		rounded <<= 1;
+	return rounded;
+}
+
+template<typename Element>
+ThreadSafeQueue5<Element>::ThreadSafeQueue5(size_t capacity) :
+		m_mask(ring_buffer_capacity(capacity) - 1), m_slots(
+				new Slot[m_mask + 1]), m_head(0), m_tail(0) {
+	for (size_t i = 0; i <= m_mask; ++i)
+		m_slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+template<typename Element>
+ThreadSafeQueue5<Element>::~ThreadSafeQueue5() {
+	size_t position;
+	while (Slot *slot = claimPopSlot(position)) {
+		reinterpret_cast<Element*>(&slot->m_data)->~Element();
+		releasePopSlot(slot, position);
+	}
+}
+
+template<typename Element>
+bool ThreadSafeQueue5<Element>::empty() const {
+	return m_head.load(std::memory_order_acquire)
+			>= m_tail.load(std::memory_order_acquire);
+}
+
+template<typename Element>
+size_t ThreadSafeQueue5<Element>::size() const {
+	const size_t head = m_head.load(std::memory_order_acquire);
+	const size_t tail = m_tail.load(std::memory_order_acquire);
+	return tail > head ? tail - head : 0;
+}
+
+template<typename Element>
+size_t ThreadSafeQueue5<Element>::capacity() const {
+	return m_mask + 1;
+}
+
+template<typename Element>
+typename ThreadSafeQueue5<Element>::Slot* ThreadSafeQueue5<Element>::claimPushSlot(
+		size_t &position) {
+	position = m_tail.load(std::memory_order_relaxed);
+	while (true) {
+		Slot *slot = &m_slots[position & m_mask];
+		const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+		const intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+		if (difference == 0) {
+			if (m_tail.compare_exchange_weak(position, position + 1,
+					std::memory_order_relaxed))
+				return slot;
+		} else if (difference < 0)
+			return nullptr; // full
+		else
+			position = m_tail.load(std::memory_order_relaxed);
+	}
+}
+
+template<typename Element>
+typename ThreadSafeQueue5<Element>::Slot* ThreadSafeQueue5<Element>::claimPopSlot(
+		size_t &position) {
+	position = m_head.load(std::memory_order_relaxed);
+	while (true) {
+		Slot *slot = &m_slots[position & m_mask];
+		const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+		const intptr_t difference = (intptr_t) sequence
+				- (intptr_t) (position + 1);
+		if (difference == 0) {
+			if (m_head.compare_exchange_weak(position, position + 1,
+					std::memory_order_relaxed))
+				return slot;
+		} else if (difference < 0)
+			return nullptr; // empty
+		else
+			position = m_head.load(std::memory_order_relaxed);
+	}
+}
+
+template<typename Element>
+void ThreadSafeQueue5<Element>::releasePopSlot(Slot *slot, size_t position) {
+	slot->sequence.store(position + m_mask + 1, std::memory_order_release);
+}
+
+template<typename Element>
+bool ThreadSafeQueue5<Element>::tryMoveIn(Element &element) noexcept {
+	size_t position;
+	Slot *slot = claimPushSlot(position);
+	if (!slot)
+		return false;
+	new (&slot->m_data) Element(std::move(element));
+	slot->sequence.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+template<typename Element>
+template<typename ...Ts>
+bool ThreadSafeQueue5<Element>::tryEmplace(Ts &&... pars) {
+	// built before a slot is claimed (the constructor may throw)
+	Element element(std::forward<Ts>(pars)...);
+	return tryMoveIn(element);
+}
+
+template<typename Element>
+bool ThreadSafeQueue5<Element>::tryPush(const Element &element) {
+	Element copy(element);
+	return tryMoveIn(copy);
+}
+
+template<typename Element>
+bool ThreadSafeQueue5<Element>::tryPush(Element &&element) {
+	return tryMoveIn(element);
+}
+
+template<typename Element>
+void ThreadSafeQueue5<Element>::push(const Element &element) {
+	Element copy(element);
+	while (!tryMoveIn(copy))
+		std::this_thread::yield();
+}
+
+template<typename Element>
+void ThreadSafeQueue5<Element>::push(Element &&element) {
+	while (!tryMoveIn(element))
+		std::this_thread::yield();
+}
+
+template<typename Element>
+template<typename ...Ts>
+void ThreadSafeQueue5<Element>::emplace(Ts &&... pars) {
+	Element element(std::forward<Ts>(pars)...);
+	while (!tryMoveIn(element))
+		std::this_thread::yield();
+}
+
+template<typename Element>
+bool ThreadSafeQueue5<Element>::tryPop(Element &element) {
+	size_t position;
+	Slot *slot = claimPopSlot(position);
+	if (!slot)
+		return false;
+	// moved out and released before the (possibly throwing) assignment
+	Element *data = reinterpret_cast<Element*>(&slot->m_data);
+	Element front_element(std::move(*data));
+	data->~Element();
+	releasePopSlot(slot, position);
+	element = std::move(front_element);
+	return true;
+}
+
+template<typename Element>
+typename ThreadSafeQueue5<Element>::ElementPtr ThreadSafeQueue5<Element>::tryPop() {
+	size_t position;
+	Slot *slot = claimPopSlot(position);
+	if (!slot)
+		return ElementPtr(nullptr);
+	// moved out and released before the allocation
+	Element *data = reinterpret_cast<Element*>(&slot->m_data);
+	Element front_element(std::move(*data));
+	data->~Element();
+	releasePopSlot(slot, position);
+	return std::make_unique<Element>(std::move(front_element));
+}
+
+#endif /* THREADSAFE_QUEUE5_H_ */
@@ -0,0 +1,203 @@
+/*
+ * threadsafe_queue6.h
+ *
+ * Lock-free thread-safe unbounded queue implemented using a singly-linked list
+ * of raw pointers with a dummy node (Michael-Scott queue), atomic operations,
+ * and a memory reclamation policy (hazard pointers by default) for ABA safety
+ * and node deletion. The elements are stored in the nodes, which come from an
+ * allocation policy (plain new/delete by default, see node_pool.h).
+ *
+ */
+
+#ifndef THREADSAFE_QUEUE6_H_
+#define THREADSAFE_QUEUE6_H_
+
+#include <memory> // std::unique_ptr
+#include <type_traits> // std::aligned_storage
+#include <utility> // std::move, std::forward
+#include <atomic> // std::atomic
+#include <exception> // std::exception
+#include "hazard_pointers.h"
+#include "node_pool.h"
+
+template<typename Element, typename Reclaimer = hazard_pointer_domain,
+		typename Allocator = default_node_allocator>
+class ThreadSafeQueue6 {
+	typedef std::unique_ptr<Element> ElementUPtr;
+
+	struct EmptyQueue: public std::exception {
+		virtual const char* what() const noexcept (true) override {
+			return "Empty Queue";
+		}
+	};
+
+	// the element is constructed by push and destroyed by the pop that moves
+	// it out, so the dummy node holds none
+	struct Node {
+		Node() :
+				next(nullptr) {
+		}
+		~Node() = default;
+		Element* data() {
+			return reinterpret_cast<Element*>(&m_data);
+		}
+		typename std::aligned_storage<sizeof(Element), alignof(Element)>::type m_data;
+		std::atomic<Node*> next;
+	};
+public:
+	ThreadSafeQueue6();
+	~ThreadSafeQueue6();
+	ThreadSafeQueue6(const ThreadSafeQueue6&) = delete;
+	ThreadSafeQueue6& operator=(const ThreadSafeQueue6&) = delete;
+	ThreadSafeQueue6(ThreadSafeQueue6&&) = delete;
+	ThreadSafeQueue6& operator=(ThreadSafeQueue6&&) = delete;
+
+	bool empty() const;
+	void push(const Element &element);
+	void push(Element &&element);
+	template<typename ...Ts>
+	void emplace(Ts &&... pars);
+	std::unique_ptr<Element> tryPop();
+	bool tryPop(Element &element);
+private:
+	template<typename ...Ts>
+	Node* createNode(Ts &&... pars);
+	void pushNode(Node *new_node);
+	template<typename Consumer>
+	bool popNode(Consumer &&consume);
+
+	std::atomic<Node*> m_label_front; // dummy node
+	std::atomic<Node*> m_label_back;
+};
+
+template<typename Element, typename Reclaimer, typename Allocator>
+ThreadSafeQueue6<Element, Reclaimer, Allocator>::ThreadSafeQueue6() :
+		m_label_front(Allocator::template create<Node>()), m_label_back(
+				m_label_front.load()) {
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+ThreadSafeQueue6<Element, Reclaimer, Allocator>::~ThreadSafeQueue6() {
+	// the dummy node holds no element
+	Node *node = m_label_front.load(std::memory_order_relaxed);
+	Node *next = node->next.load(std::memory_order_relaxed);
+	Allocator::destroy(node);
+	while (next) {
+		node = next;
+		next = node->next.load(std::memory_order_relaxed);
+		node->data()->~Element();
+		Allocator::destroy(node);
+	}
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+bool ThreadSafeQueue6<Element, Reclaimer, Allocator>::empty() const {
+	typename Reclaimer::guard guard;
+	return !guard.protect(m_label_front)->next.load(std::memory_order_acquire);
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+template<typename ...Ts>
+typename ThreadSafeQueue6<Element, Reclaimer, Allocator>::Node* ThreadSafeQueue6<
+		Element, Reclaimer, Allocator>::createNode(Ts &&... pars) {
+	Node *new_node = Allocator::template create<Node>();
+	try {
+		new (new_node->data()) Element(std::forward<Ts>(pars)...);
+	} catch (...) {
+		Allocator::destroy(new_node);
+		throw;
+	}
+	return new_node;
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+void ThreadSafeQueue6<Element, Reclaimer, Allocator>::pushNode(Node *new_node) {
+	typename Reclaimer::guard guard;
+	while (true) {
+		Node *back = guard.protect(m_label_back);
+		Node *next = back->next.load(std::memory_order_acquire);
+		if (back != m_label_back.load(std::memory_order_acquire))
+			continue;
+		if (next) {
+			// help a lagging push to swing the back label
+			m_label_back.compare_exchange_weak(back, next,
+					std::memory_order_release, std::memory_order_relaxed);
+			continue;
+		}
+		if (back->next.compare_exchange_weak(next, new_node,
+				std::memory_order_release, std::memory_order_relaxed)) {
+			m_label_back.compare_exchange_strong(back, new_node,
+					std::memory_order_release, std::memory_order_relaxed);
+			return;
+		}
+	}
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+void ThreadSafeQueue6<Element, Reclaimer, Allocator>::push(const Element &element) {
+	pushNode(createNode(element));
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+void ThreadSafeQueue6<Element, Reclaimer, Allocator>::push(Element &&element) {
+	pushNode(createNode(std::move(element)));
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+template<typename ...Ts>
+void ThreadSafeQueue6<Element, Reclaimer, Allocator>::emplace(Ts &&... pars) {
+	pushNode(createNode(std::forward<Ts>(pars)...));
+}
+
+// unlinks the front node and hands the element to consume (false if empty)
+template<typename Element, typename Reclaimer, typename Allocator>
+template<typename Consumer>
+bool ThreadSafeQueue6<Element, Reclaimer, Allocator>::popNode(
+		Consumer &&consume) {
+	typename Reclaimer::guard front_guard;
+	typename Reclaimer::guard next_guard;
+	while (true) {
+		Node *front = front_guard.protect(m_label_front);
+		Node *next = next_guard.protect(front->next);
+		if (front != m_label_front.load(std::memory_order_acquire))
+			continue;
+		if (!next)
+			return false;
+		Node *back = m_label_back.load(std::memory_order_acquire);
+		if (front == back) {
+			// help a lagging push before the back label falls behind the front
+			m_label_back.compare_exchange_weak(back, next,
+					std::memory_order_release, std::memory_order_relaxed);
+			continue;
+		}
+		if (m_label_front.compare_exchange_weak(front, next,
+				std::memory_order_acq_rel, std::memory_order_relaxed)) {
+			// next is the new dummy node, its element now belongs to this
+			// thread (and next stays protected while it is moved out)
+			consume(std::move(*next->data()));
+			next->data()->~Element();
+			front_guard.reset();
+			next_guard.reset();
+			Reclaimer::template retire<Node, Allocator>(front);
+			return true;
+		}
+	}
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+std::unique_ptr<Element> ThreadSafeQueue6<Element, Reclaimer, Allocator>::tryPop() {
+	ElementUPtr front_element(nullptr);
+	popNode([&front_element](Element &&element) {
+		front_element = std::make_unique<Element>(std::move(element));
+	});
+	return front_element;
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+bool ThreadSafeQueue6<Element, Reclaimer, Allocator>::tryPop(Element &element) {
+	return popNode([&element](Element &&front_element) {
+		element = std::move(front_element);
+	});
+}
+
+#endif /* THREADSAFE_QUEUE6_H_ */
@@ -0,0 +1,22 @@
+/*
+ * threadsafe_queue7.h
+ *
+ * Thread-safe unbounded queue implemented using flat combining over a library
+ * queue: the operations of all threads are published in per-thread records
+ * and applied in batches by the thread holding the combiner lock.
+ *
+ */
+
+#ifndef THREADSAFE_QUEUE7_H_
+#define THREADSAFE_QUEUE7_H_
+
+#include <queue> // std::queue
+#include <deque> // std::deque
+#include "flat_combining.h"
+
+template<typename Element>
+class ThreadSafeQueue7: public flat_combining_container<Element,
+		std::queue<Element, std::deque<Element>>> {
+};
+
+#endif /* THREADSAFE_QUEUE7_H_ */
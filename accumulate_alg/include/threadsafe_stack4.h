@@ -0,0 +1,150 @@
+/*
+ * threadsafe_stack4.h
+ *
+ * Lock-free thread-safe unbounded stack implemented using a singly-linked list
+ * of raw pointers (Treiber stack), atomic operations, and a memory reclamation
+ * policy (hazard pointers by default) for ABA safety and node deletion. The
+ * elements are stored in the nodes, which come from an allocation policy
+ * (plain new/delete by default, see node_pool.h).
+ *
+ */
+
+#ifndef THREADSAFE_STACK4_H_
+#define THREADSAFE_STACK4_H_
+
+#include <memory> // std::unique_ptr
+#include <utility> // std::move, std::forward
+#include <atomic> // std::atomic
+#include <exception> // std::exception
+#include "hazard_pointers.h"
+#include "node_pool.h"
+
+template<typename Element, typename Reclaimer = hazard_pointer_domain,
+		typename Allocator = default_node_allocator>
+class ThreadSafeStack4 {
+	typedef std::unique_ptr<Element> ElementUPtr;
+
+	struct EmptyStack: public std::exception {
+		virtual const char* what() const noexcept (true) override {
+			return "Empty stack";
+		}
+	};
+
+	struct Node {
+		template<typename ...Ts>
+		Node(Ts &&... pars) :
+				m_data(std::forward<Ts>(pars)...), next(nullptr) {
+		}
+		~Node() = default;
+		Element m_data;
+		Node *next;
+	};
+public:
+	ThreadSafeStack4();
+	~ThreadSafeStack4();
+	ThreadSafeStack4(const ThreadSafeStack4&) = delete;
+	ThreadSafeStack4& operator=(const ThreadSafeStack4&) = delete;
+	ThreadSafeStack4(ThreadSafeStack4&&) = delete;
+	ThreadSafeStack4& operator=(ThreadSafeStack4&&) = delete;
+
+	bool empty() const;
+	void push(const Element &element);
+	void push(Element &&element);
+	template<typename ...Ts>
+	void emplace(Ts &&... pars);
+	std::unique_ptr<Element> tryPop();
+	bool tryPop(Element &element);
+private:
+	Node* popNode(typename Reclaimer::guard &guard);
+
+	void pushNode(Node *new_node);
+
+	std::atomic<Node*> m_head;
+};
+
+template<typename Element, typename Reclaimer, typename Allocator>
+ThreadSafeStack4<Element, Reclaimer, Allocator>::ThreadSafeStack4() :
+		m_head(nullptr) {
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+ThreadSafeStack4<Element, Reclaimer, Allocator>::~ThreadSafeStack4() {
+	Node *node = m_head.load(std::memory_order_relaxed);
+	while (node) {
+		Node *next = node->next;
+		Allocator::destroy(node);
+		node = next;
+	}
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+bool ThreadSafeStack4<Element, Reclaimer, Allocator>::empty() const {
+	return !m_head.load(std::memory_order_relaxed);
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+void ThreadSafeStack4<Element, Reclaimer, Allocator>::pushNode(Node *new_node) {
+	new_node->next = m_head.load(std::memory_order_relaxed);
+	while (!m_head.compare_exchange_weak(new_node->next, new_node,
+			std::memory_order_release, std::memory_order_relaxed))
+		;
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+void ThreadSafeStack4<Element, Reclaimer, Allocator>::push(const Element &element) {
+	pushNode(Allocator::template create<Node>(element));
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+void ThreadSafeStack4<Element, Reclaimer, Allocator>::push(Element &&element) {
+	pushNode(Allocator::template create<Node>(std::move(element)));
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+template<typename ...Ts>
+void ThreadSafeStack4<Element, Reclaimer, Allocator>::emplace(Ts &&... pars) {
+	pushNode(Allocator::template create<Node>(std::forward<Ts>(pars)...));
+}
+
+// unlinks the top node, which stays protected by the guard (nullptr if empty)
+template<typename Element, typename Reclaimer, typename Allocator>
+typename ThreadSafeStack4<Element, Reclaimer, Allocator>::Node* ThreadSafeStack4<
+		Element, Reclaimer, Allocator>::popNode(typename Reclaimer::guard &guard) {
+	while (true) {
+		// the protected head cannot be deleted (nor reused), so its next
+		// pointer is valid and the exchange below is ABA-safe
+		Node *old_head = guard.protect(m_head);
+		if (!old_head)
+			return nullptr;
+		if (m_head.compare_exchange_weak(old_head, old_head->next,
+				std::memory_order_acquire, std::memory_order_relaxed))
+			return old_head;
+	}
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+std::unique_ptr<Element> ThreadSafeStack4<Element, Reclaimer, Allocator>::tryPop() {
+	typename Reclaimer::guard guard;
+	Node *old_head = popNode(guard);
+	if (!old_head)
+		return std::unique_ptr<Element>(nullptr);
+	guard.reset();
+	ElementUPtr front_element(
+			std::make_unique<Element>(std::move(old_head->m_data)));
+	Reclaimer::template retire<Node, Allocator>(old_head);
+	return front_element;
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+bool ThreadSafeStack4<Element, Reclaimer, Allocator>::tryPop(Element &element) {
+	typename Reclaimer::guard guard;
+	Node *old_head = popNode(guard);
+	if (!old_head)
+		return false;
+	guard.reset();
+	element = std::move(old_head->m_data);
+	Reclaimer::template retire<Node, Allocator>(old_head);
+	return true;
+}
+
+#endif /* THREADSAFE_STACK4_H_ */
@@ -0,0 +1,22 @@
+/*
+ * threadsafe_stack6.h
+ *
+ * Thread-safe unbounded stack implemented using flat combining over a library
+ * stack: the operations of all threads are published in per-thread records
+ * and applied in batches by the thread holding the combiner lock.
+ *
+ */
+
+#ifndef THREADSAFE_STACK6_H_
+#define THREADSAFE_STACK6_H_
+
+#include <stack> // std::stack
+#include <vector> // std::vector
+#include "flat_combining.h"
+
+template<typename Element>
+class ThreadSafeStack6: public flat_combining_container<Element,
+		std::stack<Element, std::vector<Element>>> {
+};
+
+#endif /* THREADSAFE_STACK6_H_ */
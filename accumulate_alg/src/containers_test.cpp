@@ -0,0 +1,317 @@
+//============================================================================
+// Script for testing the performance of the thread-safe containers
+//============================================================================
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include "timer.h"
+#include "threadsafe_stack2.h"
+#include "threadsafe_stack3.h"
+#include "threadsafe_queue2.h"
+#include "threadsafe_stack4.h"
+#include "threadsafe_stack5.h"
+#include "threadsafe_stack6.h"
+#include "threadsafe_queue3.h"
+#include "threadsafe_queue4.h"
+#include "threadsafe_queue5.h"
+#include "threadsafe_queue6.h"
+#include "threadsafe_queue7.h"
+#include "epoch_reclamation.h"
+#include "node_pool.h"
+using namespace std;
+
+void usageMsg(void) {
+	string separator(50, '-');
+	ostringstream msg;
+	msg << separator << endl;
+	msg << "Usage: ./containers_test kNoperations kNthreads kNiter" << endl
+			<< endl;
+	msg << "Where: " << endl;
+	msg << "kNoperations = number of push/pop pairs (all threads together)"
+			<< endl;
+	msg << "kNthreads = max number of threads (runs with 1, 2, 4, .. threads)"
+			<< endl;
+	msg << "kNiter = number of test runs (iterations)" << endl;
+	msg << separator << endl;
+	msg << "aborting.." << endl;
+	cerr << msg.str() << endl;
+	terminate();
+}
+
+// Function to calculate mean and std dev of test run timings
+string calcMeanStd(const vector<size_t> &results) {
+
+	// mean
+	double sum = std::accumulate(results.begin(), results.end(), 0.0);
+	double mean = sum / results.size();
+
+	// std dev
+	double accum = 0.0;
+	std::for_each(results.begin(), results.end(), [&](const double d) {
+		accum += (d - mean) * (d - mean);
+	});
+	double stdev = sqrt(accum / (results.size() - 1));
+
+	// write to string
+	ostringstream os;
+	os.precision(3);
+	os << mean << " ± " << stdev;
+	return os.str();
+}
+
+// Pops into value, without allocating if the container can pop in place
+template<typename Container>
+auto tryPopValue(Container &container, size_t &value,
+		int) -> decltype(container.tryPop(value)) {
+	return container.tryPop(value);
+}
+template<typename Container>
+bool tryPopValue(Container &container, size_t &value, long) {
+	auto element = container.tryPop();
+	if (!element)
+		return false;
+	value = *element;
+	return true;
+}
+
+// Every thread pushes its share of the values and pops after every push; the
+// values left over are popped at the end. Consistent if every value pushed is
+// popped exactly once (checked through the sum).
+template<typename Container>
+bool runPushPop(const size_t kNoperations, const size_t Nthreads) {
+	Container container;
+	atomic<size_t> popped_sum(0);
+	atomic<bool> go(false);
+	vector<thread> threads;
+	for (size_t threadNo = 0; threadNo < Nthreads; ++threadNo)
+		threads.emplace_back([&, threadNo]() {
+			while (!go.load(memory_order_acquire))
+				this_thread::yield();
+			size_t sum = 0;
+			for (size_t value = threadNo; value < kNoperations; value +=
+					Nthreads) {
+				container.push(value);
+				size_t popped;
+				if (tryPopValue(container, popped, 0))
+					sum += popped;
+			}
+			popped_sum.fetch_add(sum, memory_order_relaxed);
+		});
+	go.store(true, memory_order_release);
+	for (auto &t : threads)
+		t.join();
+	size_t sum = popped_sum.load();
+	size_t popped;
+	while (tryPopValue(container, popped, 0))
+		sum += popped;
+	return sum == kNoperations * (kNoperations - 1) / 2;
+}
+
+// Half of the threads push their values in increasing order while the other
+// half pop until all values are consumed. Consistent if the values popped sum
+// up to the values pushed, in FIFO order if every consumer sees the values of
+// each producer in increasing order.
+template<typename Container>
+void runProducersConsumers(const size_t kNoperations, const size_t Nthreads,
+		bool &consistent, bool &fifo) {
+	Container container;
+	const size_t Nproducers = Nthreads / 2;
+	const size_t Nconsumers = Nthreads - Nproducers;
+	atomic<size_t> popped_count(0);
+	atomic<size_t> popped_sum(0);
+	atomic<bool> in_order(true);
+	atomic<bool> go(false);
+	vector<thread> threads;
+	for (size_t producerNo = 0; producerNo < Nproducers; ++producerNo)
+		threads.emplace_back([&, producerNo]() {
+			while (!go.load(memory_order_acquire))
+				this_thread::yield();
+			for (size_t value = producerNo; value < kNoperations; value +=
+					Nproducers)
+				container.push(value);
+		});
+	for (size_t consumerNo = 0; consumerNo < Nconsumers; ++consumerNo)
+		threads.emplace_back([&]() {
+			while (!go.load(memory_order_acquire))
+				this_thread::yield();
+			vector<size_t> next_value(Nproducers, 0); // per producer
+			size_t count = 0, sum = 0;
+			bool ordered = true;
+			while (popped_count.load(memory_order_relaxed) + count
+					< kNoperations) {
+				size_t element;
+				if (!tryPopValue(container, element, 0)) {
+					// publish the progress so the other consumers can stop
+					popped_count.fetch_add(count, memory_order_relaxed);
+					popped_sum.fetch_add(sum, memory_order_relaxed);
+					count = sum = 0;
+					this_thread::yield();
+					continue;
+				}
+				const size_t producerNo = element % Nproducers;
+				ordered = ordered && element >= next_value[producerNo];
+				next_value[producerNo] = element + Nproducers;
+				++count;
+				sum += element;
+			}
+			popped_count.fetch_add(count, memory_order_relaxed);
+			popped_sum.fetch_add(sum, memory_order_relaxed);
+			if (!ordered)
+				in_order.store(false, memory_order_relaxed);
+		});
+	go.store(true, memory_order_release);
+	for (auto &t : threads)
+		t.join();
+	consistent = consistent && container.empty()
+			&& popped_count.load() == kNoperations
+			&& popped_sum.load() == kNoperations * (kNoperations - 1) / 2;
+	fifo = fifo && in_order.load();
+}
+
+// MPMC stress test of a queue with 2, 4, .. threads
+template<typename Container>
+void stressTest(const string &name, const size_t kNoperations,
+		const size_t kNthreads, const size_t kNiter) {
+	Timer timer;
+	string separator(50, '-');
+	const size_t kNsetwNumber = 10;
+	vector<size_t> results; // container of results (timings of all test runs)
+	for (size_t Nthreads = 2; Nthreads <= max(kNthreads, size_t(2)); Nthreads *=
+			2) {
+		bool consistent = true, fifo = true;
+		results.clear();
+		for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+			timer.start();
+			runProducersConsumers<Container>(kNoperations, Nthreads, consistent,
+					fifo);
+			timer.stop();
+			results.push_back(timer.duration());
+		}
+
+		// Report result
+		cout << separator << endl;
+		cout << name << ", " << Nthreads / 2 << " producers, "
+				<< Nthreads - Nthreads / 2 << " consumers (avg of " << kNiter
+				<< " runs)" << endl;
+		cout << "Consistent: " << (consistent ? "yes" : "no") << endl;
+		cout << "FIFO per producer: " << (fifo ? "yes" : "no") << endl;
+		cout << "Test duration: " << setw(kNsetwNumber)
+				<< calcMeanStd(results) << " [ms]" << endl;
+		cout << separator << endl;
+	}
+}
+
+template<typename Container>
+void benchmark(const string &name, const size_t kNoperations,
+		const size_t kNthreads, const size_t kNiter) {
+	Timer timer;
+	string separator(50, '-');
+	const size_t kNsetwNumber = 10;
+	vector<size_t> results; // container of results (timings of all test runs)
+	for (size_t Nthreads = 1; Nthreads <= kNthreads; Nthreads *= 2) {
+		bool consistent = true;
+		results.clear();
+		for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+			timer.start();
+			consistent = runPushPop<Container>(kNoperations, Nthreads)
+					&& consistent;
+			timer.stop();
+			results.push_back(timer.duration());
+		}
+
+		// Report result
+		cout << separator << endl;
+		cout << name << ", " << Nthreads << " threads (avg of " << kNiter
+				<< " runs)" << endl;
+		cout << "Consistent: " << (consistent ? "yes" : "no") << endl;
+		cout << "Test duration: " << setw(kNsetwNumber)
+				<< calcMeanStd(results) << " [ms]" << endl;
+		cout << separator << endl;
+	}
+}
+
+int main(int argc, char *argv[]) {
+
+	if (argc < 4)
+		usageMsg();
+
+	// Test parameters
+	const size_t kNoperations = stoi(string(argv[1])); // number of push/pop pairs
+	const size_t kNthreads = stoi(string(argv[2])); // max number of threads
+	const size_t kNiter = stoi(string(argv[3])); // number of test runs (iterations)
+
+	cout << "Noperations: " << kNoperations << endl;
+	cout << "Nthreads: " << kNthreads << endl;
+	cout << "Niter: " << kNiter << endl;
+
+	// Stacks: shared_ptr with atomic free functions vs hazard pointers vs epochs
+	benchmark<ThreadSafeStack2<size_t>>("ThreadSafeStack2 (shared_ptr)",
+			kNoperations, kNthreads, kNiter);
+	benchmark<ThreadSafeStack4<size_t>>("ThreadSafeStack4 (hazard pointers)",
+			kNoperations, kNthreads, kNiter);
+	benchmark<ThreadSafeStack4<size_t, epoch_domain>>(
+			"ThreadSafeStack4 (epochs)", kNoperations, kNthreads, kNiter);
+
+	// Stacks under contention: single head vs elimination backoff
+	benchmark<ThreadSafeStack3<size_t>>(
+			"ThreadSafeStack3 (shared_ptr, acquire/release)", kNoperations,
+			kNthreads, kNiter);
+	benchmark<ThreadSafeStack5<size_t>>(
+			"ThreadSafeStack5 (elimination, hazard pointers)", kNoperations,
+			kNthreads, kNiter);
+	benchmark<ThreadSafeStack5<size_t, epoch_domain, pooled_node_allocator>>(
+			"ThreadSafeStack5 (elimination, epochs, node pool)", kNoperations,
+			kNthreads, kNiter);
+	benchmark<ThreadSafeStack6<size_t>>("ThreadSafeStack6 (flat combining)",
+			kNoperations, kNthreads, kNiter);
+
+	// Queues: tagged pointers vs hazard pointers vs epochs
+	benchmark<ThreadSafeQueue3<size_t>>("ThreadSafeQueue3 (tagged pointers)",
+			kNoperations, kNthreads, kNiter);
+	benchmark<ThreadSafeQueue4<size_t>>(
+			"ThreadSafeQueue4 (tagged pointers, acquire/release)", kNoperations,
+			kNthreads, kNiter);
+	benchmark<ThreadSafeQueue6<size_t>>("ThreadSafeQueue6 (hazard pointers)",
+			kNoperations, kNthreads, kNiter);
+	benchmark<ThreadSafeQueue6<size_t, epoch_domain>>(
+			"ThreadSafeQueue6 (epochs)", kNoperations, kNthreads, kNiter);
+	benchmark<ThreadSafeQueue7<size_t>>("ThreadSafeQueue7 (flat combining)",
+			kNoperations, kNthreads, kNiter);
+
+	// Node allocation: new/delete vs per-thread node caches
+	benchmark<ThreadSafeQueue2<size_t>>("ThreadSafeQueue2 (new/delete)",
+			kNoperations, kNthreads, kNiter);
+	benchmark<ThreadSafeQueue2<size_t, pooled_node_allocator>>(
+			"ThreadSafeQueue2 (node pool)", kNoperations, kNthreads, kNiter);
+	benchmark<ThreadSafeStack4<size_t, epoch_domain, pooled_node_allocator>>(
+			"ThreadSafeStack4 (epochs, node pool)", kNoperations, kNthreads,
+			kNiter);
+	benchmark<ThreadSafeQueue6<size_t, epoch_domain, pooled_node_allocator>>(
+			"ThreadSafeQueue6 (epochs, node pool)", kNoperations, kNthreads,
+			kNiter);
+
+	// Queues: separate producers and consumers
+	stressTest<ThreadSafeQueue3<size_t>>("ThreadSafeQueue3", kNoperations,
+			kNthreads, kNiter);
+	stressTest<ThreadSafeQueue4<size_t>>("ThreadSafeQueue4", kNoperations,
+			kNthreads, kNiter);
+	stressTest<ThreadSafeQueue5<size_t>>("ThreadSafeQueue5", kNoperations,
+			kNthreads, kNiter);
+	stressTest<ThreadSafeQueue6<size_t>>("ThreadSafeQueue6", kNoperations,
+			kNthreads, kNiter);
+	stressTest<ThreadSafeQueue7<size_t>>("ThreadSafeQueue7", kNoperations,
+			kNthreads, kNiter);
+	stressTest<ThreadSafeQueue6<size_t, hazard_pointer_domain,
+			pooled_node_allocator>>("ThreadSafeQueue6 (node pool)",
+			kNoperations, kNthreads, kNiter);
+
+	return 0;
+}
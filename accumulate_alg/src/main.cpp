@@ -6,10 +6,23 @@
 #include <iomanip>
 #include <sstream>
 #include <vector>
+#include <list>
+#include <unordered_map>
+#include <fstream>
+#include <cstdio>
 #include <algorithm>
 #include <numeric>
+#include <thread>
+#include <atomic>
 #include "timer.h"
 #include "parallel_accumulate.h"
+#include "parallel_scan.h"
+#include "parallel_accumulate_file.h"
+#include "streaming_accumulate.h"
+#include "parallel_summary.h"
+#include "parallel_histogram.h"
+#include "parallel_reduce_by_key.h"
+#include "parallel_find.h"
 using namespace std;
 
 void usageMsg(void) {
@@ -120,5 +133,417 @@ int main(int argc, char *argv[]) {
 		cout << separator << endl;
 	}
 
+	{
+		// Serial vs parallel accumulate over a linked list (forward iterators)
+		list<int> elementsList(elements.begin(), elements.end());
+		for (size_t mode = 0; mode < 2; ++mode) {
+			results.clear();
+			for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+				timer.start();
+				if (mode == 0)
+					finalSum = accumulate(elementsList.begin(),
+							elementsList.end(), 0);
+				else
+					finalSum = parallel_accumulate(elementsList.begin(),
+							elementsList.end(), 0, kNthreads);
+				timer.stop();
+				results.push_back(timer.duration());
+			}
+
+			// Report result
+			cout << separator << endl;
+			cout << (mode == 0 ? "Serial" : "Parallel")
+					<< " accumulate, std::list (avg of " << kNiter << " runs)"
+					<< endl;
+			cout << "Sum: " << finalSum << endl;
+			cout << "Test duration: " << setw(kNsetwNumber)
+					<< calcMeanStd(results) << " [ms]" << endl;
+			cout << separator << endl;
+		}
+	}
+
+	{
+		// Parallel accumulate over a memory-mapped file of packed values
+		const string path = "accumulate_test_elements.bin";
+		{
+			ofstream file(path, ios::binary);
+			file.write(reinterpret_cast<const char*>(elements.data()),
+					elements.size() * sizeof(int));
+		}
+		results.clear();
+		for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+			timer.start();
+			finalSum = parallel_accumulate_file<int>(path, 0, kNthreads);
+			timer.stop();
+			results.push_back(timer.duration());
+		}
+		remove(path.c_str());
+
+		// Report result
+		cout << separator << endl;
+		cout << "Parallel accumulate, mapped file (avg of " << kNiter
+				<< " runs)" << endl;
+		cout << "Sum: " << finalSum << endl;
+		cout << "Test duration: " << setw(kNsetwNumber)
+				<< calcMeanStd(results) << " [ms]" << endl;
+		cout << separator << endl;
+	}
+
+	{
+		// Streaming accumulate from a binary input stream (double-buffered)
+		const string path = "accumulate_test_stream.bin";
+		{
+			ofstream file(path, ios::binary);
+			file.write(reinterpret_cast<const char*>(elements.data()),
+					elements.size() * sizeof(int));
+		}
+		results.clear();
+		for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+			ifstream file(path, ios::binary);
+			timer.start();
+			finalSum = streaming_accumulate_stream<int>(file, 0, kNthreads);
+			timer.stop();
+			results.push_back(timer.duration());
+		}
+		remove(path.c_str());
+
+		// Report result
+		cout << separator << endl;
+		cout << "Streaming accumulate, input stream (avg of " << kNiter
+				<< " runs)" << endl;
+		cout << "Sum: " << finalSum << endl;
+		cout << "Test duration: " << setw(kNsetwNumber)
+				<< calcMeanStd(results) << " [ms]" << endl;
+		cout << separator << endl;
+	}
+
+	{
+		// Separate passes (accumulate, min, max, variance) vs fused parallel summary
+		summary<int> stats;
+		for (size_t mode = 0; mode < 2; ++mode) {
+			results.clear();
+			for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+				timer.start();
+				if (mode == 0) {
+					stats = summary<int>();
+					stats.count = elements.size();
+					stats.sum = parallel_accumulate(elements.begin(),
+							elements.end(), 0, kNthreads);
+					auto minmax = minmax_element(elements.begin(),
+							elements.end());
+					stats.min = *minmax.first;
+					stats.max = *minmax.second;
+					stats.argmin = minmax.first - elements.begin();
+					stats.argmax = minmax.second - elements.begin();
+					stats.mean = accumulate(elements.begin(), elements.end(),
+							0.0) / stats.count;
+					for (const int el : elements)
+						stats.m2 += (el - stats.mean) * (el - stats.mean);
+				} else
+					stats = parallel_summary(elements.begin(), elements.end(),
+							kNthreads);
+				timer.stop();
+				results.push_back(timer.duration());
+			}
+
+			// Report result
+			cout << separator << endl;
+			cout << (mode == 0 ? "Separate passes" : "Parallel summary")
+					<< " (avg of " << kNiter << " runs)" << endl;
+			cout << "Sum: " << stats.sum << ", min: " << stats.min << " (#"
+					<< stats.argmin << "), max: " << stats.max << " (#"
+					<< stats.argmax << ")" << endl;
+			cout << "Mean: " << stats.mean << ", variance: "
+					<< stats.variance() << endl;
+			cout << "Test duration: " << setw(kNsetwNumber)
+					<< calcMeanStd(results) << " [ms]" << endl;
+			cout << separator << endl;
+		}
+	}
+
+	{
+		// Serial vs parallel histogram (small and large number of bins)
+		for (const size_t kNbins : { (size_t) 16, (size_t) 65536 }) {
+			vector<size_t> reference(kNbins);
+			vector<size_t> histogram;
+			for (size_t mode = 0; mode < 2; ++mode) {
+				results.clear();
+				for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+					timer.start();
+					if (mode == 0) {
+						fill(reference.begin(), reference.end(), 0);
+						for (const int el : elements)
+							++reference[el % kNbins];
+					} else
+						histogram = parallel_histogram(elements.begin(),
+								elements.end(), kNbins,
+								[kNbins](const int el) -> size_t {
+									return el % kNbins;
+								}, kNthreads);
+					timer.stop();
+					results.push_back(timer.duration());
+				}
+
+				// Report result
+				cout << separator << endl;
+				cout << (mode == 0 ? "Serial" : "Parallel") << " histogram, "
+						<< kNbins << " bins (avg of " << kNiter << " runs)"
+						<< endl;
+				if (mode != 0)
+					cout << "Matches serial histogram: "
+							<< (histogram == reference ? "yes" : "no") << endl;
+				cout << "Test duration: " << setw(kNsetwNumber)
+						<< calcMeanStd(results) << " [ms]" << endl;
+				cout << separator << endl;
+			}
+		}
+	}
+
+	{
+		// Serial vs parallel reduce-by-key, sorted keys (runs of 1000 equal keys)
+		// and unsorted keys (1000 distinct keys)
+		vector<int> sortedKeys(elements.size());
+		vector<int> unsortedKeys(elements.size());
+		for (size_t ii = 0; ii < elements.size(); ++ii) {
+			sortedKeys[ii] = elements[ii] / 1000;
+			unsortedKeys[ii] = elements[ii] % 1000;
+		}
+		// serial groups of the sorted and of the unsorted keys (the latter
+		// ordered by key, the hashed groups come in no particular order)
+		vector<pair<int, int>> sortedReference, unsortedReference;
+		for (size_t mode = 0; mode < 4; ++mode) {
+			vector<pair<int, int>> groups;
+			results.clear();
+			for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+				timer.start();
+				if (mode == 0) {
+					groups.clear();
+					for (size_t ii = 0; ii < elements.size(); ++ii) {
+						if (!groups.empty()
+								&& groups.back().first == sortedKeys[ii])
+							groups.back().second += elements[ii];
+						else
+							groups.emplace_back(sortedKeys[ii], elements[ii]);
+					}
+				} else if (mode == 1)
+					groups = parallel_reduce_by_sorted_key(sortedKeys.begin(),
+							sortedKeys.end(), elements.begin(), kNthreads);
+				else if (mode == 2) {
+					unordered_map<int, int> map;
+					for (size_t ii = 0; ii < elements.size(); ++ii)
+						map[unsortedKeys[ii]] += elements[ii];
+					groups.assign(map.begin(), map.end());
+				} else
+					groups = parallel_reduce_by_key(unsortedKeys.begin(),
+							unsortedKeys.end(), elements.begin(), kNthreads);
+				timer.stop();
+				results.push_back(timer.duration());
+			}
+			if (mode >= 2)
+				sort(groups.begin(), groups.end());
+			vector<pair<int, int>> &reference =
+					mode < 2 ? sortedReference : unsortedReference;
+			if (mode % 2 == 0)
+				reference = groups;
+
+			// Report result
+			cout << separator << endl;
+			cout << (mode % 2 == 0 ? "Serial" : "Parallel")
+					<< " reduce-by-key, " << (mode < 2 ? "sorted" : "unsorted")
+					<< " keys (avg of " << kNiter << " runs)" << endl;
+			cout << "Groups: " << groups.size() << endl;
+			if (mode % 2 != 0)
+				cout << "Matches serial: "
+						<< (groups == reference ? "yes" : "no") << endl;
+			cout << "Test duration: " << setw(kNsetwNumber)
+					<< calcMeanStd(results) << " [ms]" << endl;
+			cout << separator << endl;
+		}
+	}
+
+	{
+		// Serial vs parallel early-terminating search (first hit at 1% and 50%
+		// of the range)
+		for (const size_t kHitPosition : { kNelements / 100, kNelements / 2 }) {
+			const int target = elements[kHitPosition];
+			auto isTarget = [target](const int el) -> bool {
+				return el == target;
+			};
+			for (size_t mode = 0; mode < 2; ++mode) {
+				size_t position = 0;
+				results.clear();
+				for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+					timer.start();
+					if (mode == 0)
+						position = find_if(elements.begin(), elements.end(),
+								isTarget) - elements.begin();
+					else
+						position = parallel_find_if(elements.begin(),
+								elements.end(), isTarget, kNthreads)
+								- elements.begin();
+					timer.stop();
+					results.push_back(timer.duration());
+				}
+
+				// Report result
+				cout << separator << endl;
+				cout << (mode == 0 ? "Serial" : "Parallel")
+						<< " find_if, hit at " << kHitPosition << " (avg of "
+						<< kNiter << " runs)" << endl;
+				cout << "Position: " << position << endl;
+				if (mode != 0)
+					cout << "any_of: "
+							<< parallel_any_of(elements.begin(), elements.end(),
+									isTarget, kNthreads) << ", all_of: "
+							<< parallel_all_of(elements.begin(), elements.end(),
+									isTarget, kNthreads) << ", none_of: "
+							<< parallel_none_of(elements.begin(),
+									elements.end(), isTarget, kNthreads)
+							<< endl;
+				cout << "Test duration: " << setw(kNsetwNumber)
+						<< calcMeanStd(results) << " [ms]" << endl;
+				cout << separator << endl;
+			}
+		}
+	}
+
+	{
+		// Static vs dynamically scheduled parallel accumulate while another
+		// thread keeps one core busy
+		atomic<bool> stopLoad(false);
+		thread load([&stopLoad]() {
+			while (!stopLoad.load(memory_order_relaxed))
+				;
+		});
+
+		const char *names[] = { "static", "dynamic", "guided" };
+		for (size_t mode = 0; mode < 3; ++mode) {
+			results.clear();
+			for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+				timer.start();
+				if (mode == 0)
+					finalSum = parallel_accumulate(elements.begin(),
+							elements.end(), 0, kNthreads);
+				else
+					finalSum = parallel_accumulate_scheduled(elements.begin(),
+							elements.end(), 0, kNthreads,
+							mode == 1 ?
+									schedule_type::dynamic :
+									schedule_type::guided);
+				timer.stop();
+				results.push_back(timer.duration());
+			}
+
+			// Report result
+			cout << separator << endl;
+			cout << "Parallel accumulate, " << names[mode]
+					<< " schedule, loaded core (avg of " << kNiter << " runs)"
+					<< endl;
+			cout << "Sum: " << finalSum << endl;
+			cout << "Test duration: " << setw(kNsetwNumber)
+					<< calcMeanStd(results) << " [ms]" << endl;
+			cout << "Max duration: " << setw(kNsetwNumber)
+					<< *max_element(results.begin(), results.end()) << " [ms]"
+					<< endl;
+			cout << separator << endl;
+		}
+
+		stopLoad.store(true, memory_order_relaxed);
+		load.join();
+	}
+
+	// floating point elements (not exactly representable, so the order of the
+	// additions changes the rounding)
+	vector<double> elementsFp(elements.size());
+	transform(elements.begin(), elements.end(), elementsFp.begin(),
+			[](const int el) -> double {
+				return el * 0.001;
+			});
+
+	{
+		// Parallel accumulate (floating point, fast path vs reproducible modes)
+		const char *names[] = { "fast", "reproducible",
+				"reproducible compensated" };
+		for (size_t mode = 0; mode < 3; ++mode) {
+			double finalSumFp = 0.0;
+			bool identical = true;
+			results.clear();
+			for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+				timer.start();
+				if (mode == 0)
+					finalSumFp = parallel_accumulate(elementsFp.begin(),
+							elementsFp.end(), 0.0, kNthreads);
+				else
+					finalSumFp = parallel_accumulate_reproducible(
+							elementsFp.begin(), elementsFp.end(), 0.0,
+							kNthreads, mode == 2);
+				timer.stop();
+				results.push_back(timer.duration());
+			}
+
+			// the reproducible modes must not depend on the number of threads
+			if (mode != 0) {
+				for (size_t Nthreads = 1; Nthreads <= kNthreads; ++Nthreads)
+					identical = identical
+							&& parallel_accumulate_reproducible(
+									elementsFp.begin(), elementsFp.end(), 0.0,
+									Nthreads, mode == 2) == finalSumFp;
+			}
+
+			// Report result
+			cout << separator << endl;
+			cout << "Parallel accumulate, " << names[mode] << " (avg of "
+					<< kNiter << " runs)" << endl;
+			cout << "Sum: " << setprecision(17) << finalSumFp
+					<< setprecision(6) << endl;
+			if (mode != 0)
+				cout << "Identical for 1.." << kNthreads << " threads: "
+						<< (identical ? "yes" : "no") << endl;
+			cout << "Test duration: " << setw(kNsetwNumber)
+					<< calcMeanStd(results) << " [ms]" << endl;
+			cout << separator << endl;
+		}
+	}
+
+	{
+		// Serial and parallel exclusive prefix scan (offset table)
+		vector<size_t> reference(elements.size());
+		vector<size_t> offsets(elements.size());
+		const char *names[] = { "Serial", "Parallel two-pass",
+				"Parallel look-back" };
+		for (size_t mode = 0; mode < 3; ++mode) {
+			results.clear();
+			for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+				timer.start();
+				if (mode == 0) {
+					size_t offset = 0;
+					for (size_t ii = 0; ii < elements.size(); ++ii) {
+						reference[ii] = offset;
+						offset += elements[ii];
+					}
+				} else if (mode == 1)
+					parallel_exclusive_scan(elements.begin(), elements.end(),
+							offsets.begin(), size_t(0), kNthreads);
+				else
+					parallel_exclusive_scan_lookback(elements.begin(),
+							elements.end(), offsets.begin(), size_t(0),
+							kNthreads);
+				timer.stop();
+				results.push_back(timer.duration());
+			}
+
+			// Report result
+			cout << separator << endl;
+			cout << names[mode] << " exclusive scan (avg of " << kNiter
+					<< " runs)" << endl;
+			if (mode != 0)
+				cout << "Matches serial scan: "
+						<< (offsets == reference ? "yes" : "no") << endl;
+			cout << "Test duration: " << setw(kNsetwNumber)
+					<< calcMeanStd(results) << " [ms]" << endl;
+			cout << separator << endl;
+		}
+	}
+
 	return 0;
 }
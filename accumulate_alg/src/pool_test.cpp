@@ -0,0 +1,248 @@
+//============================================================================
+// Script for comparing the container policies of the thread pool
+//============================================================================
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <numeric>
+#include <future>
+#include <chrono>
+#include "timer.h"
+#include "thread_pool.h"
+using namespace std;
+
+// number of elements summed by a single task
+constexpr size_t kTaskGrain = 64;
+
+// number of tasks submitted by the main thread before it waits for them
+// (every waiting task may run another one on top of its stack)
+constexpr size_t kTaskBatch = 4096;
+constexpr size_t kParentBatch = 64;
+
+// number of tasks submitted by every task of the main thread in the nested test
+constexpr size_t kChildTasks = 64;
+
+// Containers with extra template parameters (reclaimer, allocator) are passed
+// to the pool through aliases with the default policies
+template<typename T>
+using ThreadSafeQueue2Type = ThreadSafeQueue2<T>;
+template<typename T>
+using ThreadSafeQueue6Type = ThreadSafeQueue6<T>;
+template<typename T>
+using ThreadSafeStack4Type = ThreadSafeStack4<T>;
+template<typename T>
+using ThreadSafeStack5Type = ThreadSafeStack5<T>;
+
+void usageMsg(void) {
+	string separator(50, '-');
+	ostringstream msg;
+	msg << separator << endl;
+	msg << "Usage: ./pool_test kNtasks kNthreads kNiter" << endl << endl;
+	msg << "Where: " << endl;
+	msg << "kNtasks = number of tasks per test run" << endl;
+	msg << "kNthreads = number of threads (main thread and workers)" << endl;
+	msg << "kNiter = number of test runs (iterations)" << endl;
+	msg << separator << endl;
+	msg << "aborting.." << endl;
+	cerr << msg.str() << endl;
+	terminate();
+}
+
+// Runs task(first, last) for blocks of blockSize elements in the pool, waits
+// for all of them and sums the results
+template<typename Pool, typename Task>
+size_t runBlocks(Pool &pool, const size_t first, const size_t last,
+		const size_t blockSize, Task task) {
+	vector<future<size_t>> results;
+	results.reserve((last - first + blockSize - 1) / blockSize);
+	for (size_t blockFirst = first; blockFirst < last; blockFirst += blockSize) {
+		const size_t blockLast = min(blockFirst + blockSize, last);
+		results.push_back(pool.submit([task, blockFirst, blockLast]() {
+			return task(blockFirst, blockLast);
+		}));
+	}
+	size_t sum = 0;
+	for (auto &result : results) {
+		while (result.wait_for(std::chrono::seconds(0))
+				== std::future_status::timeout)
+			pool.run_pending_task();
+		sum += result.get();
+	}
+	return sum;
+}
+
+// Independent tasks submitted by the main thread
+template<typename Pool>
+size_t runFlatTasks(Pool &pool, const vector<size_t> &elements) {
+	auto sumBlock = [&elements](size_t first, size_t last) {
+		return accumulate(elements.begin() + first, elements.begin() + last,
+				size_t(0));
+	};
+	const size_t batchSize = kTaskBatch * kTaskGrain;
+	size_t sum = 0;
+	for (size_t first = 0; first < elements.size(); first += batchSize)
+		sum += runBlocks(pool, first, min(first + batchSize, elements.size()),
+				kTaskGrain, sumBlock);
+	return sum;
+}
+
+// Tasks submitted by tasks: every task of the main thread hands off
+// kChildTasks tasks from its worker, which the other workers steal
+template<typename Pool>
+size_t runNestedTasks(Pool &pool, const vector<size_t> &elements) {
+	auto sumBlock = [&elements](size_t first, size_t last) {
+		return accumulate(elements.begin() + first, elements.begin() + last,
+				size_t(0));
+	};
+	auto splitBlock = [&pool, sumBlock](size_t first, size_t last) {
+		return runBlocks(pool, first, last, kTaskGrain, sumBlock);
+	};
+	const size_t parentSize = kChildTasks * kTaskGrain;
+	const size_t batchSize = kParentBatch * parentSize;
+	size_t sum = 0;
+	for (size_t first = 0; first < elements.size(); first += batchSize)
+		sum += runBlocks(pool, first, min(first + batchSize, elements.size()),
+				parentSize, splitBlock);
+	return sum;
+}
+
+// Throughput in tasks per ms from the mean duration of the test runs
+string calcThroughput(const size_t Ntasks, const vector<size_t> &results) {
+	const double mean = std::accumulate(results.begin(), results.end(), 0.0)
+			/ results.size();
+	ostringstream os;
+	os << fixed << setprecision(1) << Ntasks / max(mean, 1.0);
+	return os.str();
+}
+
+// Column widths of the result tables
+constexpr size_t kNsetwName = 18;
+constexpr size_t kNsetwNumber = 12;
+
+void printHeader(const string &first_name, const string &second_name) {
+	string separator(2 * kNsetwName + 5 * kNsetwNumber, '-');
+	cout << separator << endl;
+	cout << left << setw(kNsetwName) << first_name << setw(kNsetwName)
+			<< second_name << right << setw(kNsetwNumber) << "Flat"
+			<< setw(kNsetwNumber) << "Nested" << setw(kNsetwNumber) << "Steals"
+			<< setw(kNsetwNumber) << "Batch" << setw(kNsetwNumber)
+			<< "Consistent" << endl;
+	cout << setw(2 * kNsetwName + 2 * kNsetwNumber) << "[tasks/ms]"
+			<< setw(kNsetwNumber) << "" << setw(kNsetwNumber) << "[tasks]"
+			<< endl;
+	cout << separator << endl;
+}
+
+template<template<typename > class MasterContainer,
+		template<typename > class WorkerContainer>
+void benchmarkPool(const string &master_name, const string &worker_name,
+		const vector<size_t> &elements, const size_t kNthreads,
+		const size_t kNiter, const steal_policy &policy = steal_policy()) {
+	Timer timer;
+	const size_t Ntasks = (elements.size() + kTaskGrain - 1) / kTaskGrain;
+	const size_t serialSum = accumulate(elements.begin(), elements.end(),
+			size_t(0));
+	bool consistent = true;
+	vector<size_t> flatResults, nestedResults;
+	basic_thread_pool<MasterContainer, WorkerContainer> pool(kNthreads - 1,
+			policy);
+	for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+		timer.start();
+		consistent = runFlatTasks(pool, elements) == serialSum && consistent;
+		timer.stop();
+		flatResults.push_back(timer.duration());
+
+		timer.start();
+		consistent = runNestedTasks(pool, elements) == serialSum && consistent;
+		timer.stop();
+		nestedResults.push_back(timer.duration());
+	}
+
+	// Report result (steals of all test runs, mean tasks per steal)
+	const steal_statistics steals = pool.statistics();
+	ostringstream batch;
+	batch << fixed << setprecision(1)
+			<< (steals.Nsteals ? double(steals.Ntasks) / steals.Nsteals : 0.0);
+	cout << left << setw(kNsetwName) << master_name << setw(kNsetwName)
+			<< worker_name << right << setw(kNsetwNumber)
+			<< calcThroughput(Ntasks, flatResults) << setw(kNsetwNumber)
+			<< calcThroughput(Ntasks, nestedResults) << setw(kNsetwNumber)
+			<< steals.Nsteals << setw(kNsetwNumber) << batch.str()
+			<< setw(kNsetwNumber) << (consistent ? "yes" : "no") << endl;
+}
+
+// Runs the pool with every pair of the containers (master x workers)
+template<template<typename > class ... Containers>
+struct pool_matrix {
+	template<template<typename > class MasterContainer>
+	static void runRow(const vector<string> &names, const size_t master,
+			const vector<size_t> &elements, const size_t kNthreads,
+			const size_t kNiter) {
+		size_t worker = 0;
+		int expand[] = { (benchmarkPool<MasterContainer, Containers>(
+				names[master], names[worker++], elements, kNthreads, kNiter), 0)... };
+		(void) expand;
+	}
+	static void run(const vector<string> &names, const vector<size_t> &elements,
+			const size_t kNthreads, const size_t kNiter) {
+		size_t master = 0;
+		int expand[] = { (runRow<Containers>(names, master++, elements,
+				kNthreads, kNiter), 0)... };
+		(void) expand;
+	}
+};
+
+int main(int argc, char *argv[]) {
+
+	if (argc < 4)
+		usageMsg();
+
+	// Test parameters
+	const size_t kNtasks = stoi(string(argv[1])); // number of tasks per test run
+	const size_t kNthreads = max(stoi(string(argv[2])), 1); // number of threads
+	const size_t kNiter = stoi(string(argv[3])); // number of test runs (iterations)
+
+	cout << "Ntasks: " << kNtasks << endl;
+	cout << "Nthreads: " << kNthreads << endl;
+	cout << "Niter: " << kNiter << endl;
+
+	vector<size_t> elements(kNtasks * kTaskGrain);
+	iota(elements.begin(), elements.end(), size_t(0));
+
+	string separator(2 * kNsetwName + 5 * kNsetwNumber, '-');
+	printHeader("Master", "Workers");
+
+	const vector<string> names = { "ThreadSafeQueue1", "ThreadSafeQueue2",
+			"ThreadSafeQueue3", "ThreadSafeQueue4", "ThreadSafeQueue5",
+			"ThreadSafeQueue6", "ThreadSafeQueue7", "ThreadSafeStack1",
+			"ThreadSafeStack2", "ThreadSafeStack3", "ThreadSafeStack4",
+			"ThreadSafeStack5", "ThreadSafeStack6" };
+	pool_matrix<ThreadSafeQueue1, ThreadSafeQueue2Type, ThreadSafeQueue3,
+			ThreadSafeQueue4, ThreadSafeQueue5, ThreadSafeQueue6Type,
+			ThreadSafeQueue7, ThreadSafeStack1, ThreadSafeStack2,
+			ThreadSafeStack3, ThreadSafeStack4Type, ThreadSafeStack5Type,
+			ThreadSafeStack6>::run(names, elements, kNthreads, kNiter);
+	cout << separator << endl << endl;
+
+	// Victim selection and batch size of the idle workers (default containers)
+	printHeader("Victims", "Rounds, steal");
+	const vector<pair<string, victim_selection>> selections = { {
+			"sequential", victim_selection::sequential }, { "random",
+			victim_selection::random }, { "topology",
+			victim_selection::topology } };
+	for (const auto &selection : selections)
+		for (size_t Nrounds = 1; Nrounds <= 4; Nrounds *= 2)
+			for (bool steal_half : { false, true })
+				benchmarkPool<ThreadSafeContainerType, ThreadSafeContainerType>(
+						selection.first,
+						to_string(Nrounds) + (steal_half ? ", half" : ", one"),
+						elements, kNthreads, kNiter,
+						steal_policy(selection.second, Nrounds, steal_half));
+	cout << separator << endl;
+
+	return 0;
+}
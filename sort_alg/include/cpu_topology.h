@@ -0,0 +1,149 @@
+/*
+ * cpu_topology.h
+ *
+ * Cache topology of the cpus the process may run on, read from
+ * /sys/devices/system/cpu (Linux). Two cpus are at distance 0 if they share
+ * an L2 cache, 1 if they share an L3 cache and 2 otherwise. Without cache
+ * information the hardware threads of a core stand in for the L2 sharers and
+ * the cpus of a package for the L3 sharers; without any information all cpus
+ * are remote.
+ *
+ */
+
+#ifndef CPU_TOPOLOGY_H_
+#define CPU_TOPOLOGY_H_
+
+#include <vector> // std::vector
+#include <string> // std::string, std::to_string
+#include <fstream> // std::ifstream
+#include <sstream> // std::istringstream
+#include <thread> // std::thread::native_handle_type
+#ifdef __linux__
+#include <sched.h> // sched_getaffinity, cpu_set_t
+#include <pthread.h> // pthread_setaffinity_np
+#endif
+
+// distances between two cpus
+constexpr size_t kSharedL2 = 0;
+constexpr size_t kSharedL3 = 1;
+constexpr size_t kRemote = 2;
+
+class cpu_topology {
+public:
+	cpu_topology();
+	~cpu_topology() = default;
+
+	// cpus the process may run on
+	const std::vector<int>& cpus() const {
+		return m_cpus;
+	}
+	size_t distance(int cpu1, int cpu2) const;
+	// restricts the thread to the cpu, false if not supported
+	static bool pin(std::thread::native_handle_type thread, int cpu);
+private:
+	static std::vector<int> read_cpu_list(const std::string &path);
+	static int read_int(const std::string &path);
+	void read_groups(int cpu);
+
+	std::vector<int> m_cpus;
+	// lowest cpu sharing the cache with a cpu (-1 if unknown)
+	std::vector<int> m_l2_group;
+	std::vector<int> m_l3_group;
+};
+
+inline cpu_topology::cpu_topology() {
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (!sched_getaffinity(0, sizeof(set), &set))
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+			if (CPU_ISSET(cpu, &set))
+				m_cpus.push_back(cpu);
+#endif
+	if (m_cpus.empty())
+		m_cpus.push_back(0);
+	m_l2_group.assign(m_cpus.back() + 1, -1);
+	m_l3_group.assign(m_cpus.back() + 1, -1);
+	for (int cpu : m_cpus)
+		read_groups(cpu);
+}
+
+// parses a list like "0-3,8,10-11" (empty if the file is missing)
+inline std::vector<int> cpu_topology::read_cpu_list(const std::string &path) {
+	std::vector<int> cpus;
+	std::ifstream file(path);
+	std::string range;
+	while (std::getline(file, range, ',')) {
+		std::istringstream is(range);
+		int first, last;
+		if (!(is >> first))
+			break;
+		last = first;
+		if (is.get() == '-' && !(is >> last))
+			break;
+		for (int cpu = first; cpu <= last; ++cpu)
+			cpus.push_back(cpu);
+	}
+	return cpus;
+}
+
+inline int cpu_topology::read_int(const std::string &path) {
+	std::ifstream file(path);
+	int value = -1;
+	file >> value;
+	return value;
+}
+
+inline void cpu_topology::read_groups(int cpu) {
+	const std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+	std::vector<int> l2_cpus, l3_cpus;
+	for (size_t index = 0;; ++index) {
+		const std::string cache = dir + "/cache/index" + std::to_string(index);
+		const int level = read_int(cache + "/level");
+		if (level < 0)
+			break;
+		if (level == 2)
+			l2_cpus = read_cpu_list(cache + "/shared_cpu_list");
+		else if (level == 3)
+			l3_cpus = read_cpu_list(cache + "/shared_cpu_list");
+	}
+	if (l2_cpus.empty())
+		l2_cpus = read_cpu_list(dir + "/topology/thread_siblings_list");
+	if (l3_cpus.empty())
+		l3_cpus = read_cpu_list(dir + "/topology/core_siblings_list");
+	if (!l2_cpus.empty())
+		m_l2_group[cpu] = l2_cpus.front();
+	if (!l3_cpus.empty())
+		m_l3_group[cpu] = l3_cpus.front();
+}
+
+inline size_t cpu_topology::distance(int cpu1, int cpu2) const {
+	const int Ncpus = m_l2_group.size();
+	if (cpu1 < 0 || cpu2 < 0 || cpu1 >= Ncpus || cpu2 >= Ncpus)
+		return kRemote;
+	if (cpu1 == cpu2
+			|| (m_l2_group[cpu1] >= 0 && m_l2_group[cpu1] == m_l2_group[cpu2]))
+		return kSharedL2;
+	if (m_l3_group[cpu1] >= 0 && m_l3_group[cpu1] == m_l3_group[cpu2])
+		return kSharedL3;
+	return kRemote;
+}
+
+inline bool cpu_topology::pin(std::thread::native_handle_type thread, int cpu) {
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return !pthread_setaffinity_np(thread, sizeof(set), &set);
+#else
+	return false;
+#endif
+}
+
+// topology read once per process
+inline const cpu_topology& system_topology() {
+	static const cpu_topology topology;
+	return topology;
+}
+
+#endif /* CPU_TOPOLOGY_H_ */
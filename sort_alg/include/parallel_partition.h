@@ -0,0 +1,264 @@
+/*
+ * parallel_partition.h
+ *
+ * Multithreaded partition, stable_partition and copy_if algorithms for
+ * contiguous (random access) ranges
+ *
+ */
+
+#ifndef PARALLEL_PARTITION_H_
+#define PARALLEL_PARTITION_H_
+
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <utility>
+#include <future>
+#include <chrono>
+#include <thread>
+#include "thread_pool.h"
+
+// Runs task(0) .. task(Ntasks - 1) on the pool; the calling thread runs the
+// last task itself and helps the pool while waiting for the others (so it can
+// be called from inside a pool task as well)
+template<typename Task>
+void run_tasks(thread_pool &pool, size_t Ntasks, Task task) {
+	std::vector<std::future<void>> future_results(Ntasks - 1);
+	for (size_t taskNo = 0; taskNo < Ntasks - 1; ++taskNo)
+		future_results[taskNo] = pool.submit([taskNo, &task]() {
+			task(taskNo);
+		});
+	task(Ntasks - 1);
+	for (auto &future_result : future_results) {
+		while (future_result.wait_for(std::chrono::seconds(0))
+				!= std::future_status::ready)
+			pool.run_pending_task();
+		future_result.get();
+	}
+}
+
+// Bounds of chunk chunkNo when Nelements are split into Nchunks chunks
+inline std::pair<size_t, size_t> chunk_bounds(size_t Nelements, size_t Nchunks,
+		size_t chunkNo) {
+	return std::make_pair(Nelements * chunkNo / Nchunks,
+			Nelements * (chunkNo + 1) / Nchunks);
+}
+
+// Unstable in-place partition on an existing pool: every chunk is partitioned
+// locally, then the elements on the wrong side of the global boundary (the
+// false ones before it, the true ones after it) are swapped pairwise in parallel
+template<typename Iterator, typename Predicate>
+Iterator parallel_partition(thread_pool &pool, Iterator first, Iterator last,
+		Predicate pred, size_t Nchunks) {
+
+	// number of elements
+	const size_t Nelements = std::distance(first, last);
+	if (Nchunks > Nelements)
+		Nchunks = Nelements;
+	if (Nchunks < 2)
+		return std::partition(first, last, pred);
+
+	// local partitions
+	std::vector<size_t> Ntrue(Nchunks);
+	run_tasks(pool, Nchunks, [&](size_t chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nchunks, chunkNo);
+		Ntrue[chunkNo] = std::partition(first + bounds.first,
+				first + bounds.second, pred) - (first + bounds.first);
+	});
+
+	// global boundary
+	size_t boundary = 0;
+	for (const size_t count : Ntrue)
+		boundary += count;
+
+	// misplaced segments (start, length): false elements before the boundary
+	// and true elements after it, both in position order
+	std::vector<std::pair<size_t, size_t>> misplaced_false;
+	std::vector<std::pair<size_t, size_t>> misplaced_true;
+	size_t Nmisplaced = 0;
+	for (size_t chunkNo = 0; chunkNo < Nchunks; ++chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nchunks, chunkNo);
+		const size_t divide = bounds.first + Ntrue[chunkNo];
+		if (divide < boundary && divide < bounds.second) {
+			misplaced_false.emplace_back(divide,
+					std::min(bounds.second, boundary) - divide);
+			Nmisplaced += misplaced_false.back().second;
+		}
+		if (divide > boundary && bounds.first < divide) {
+			const size_t start = std::max(bounds.first, boundary);
+			misplaced_true.emplace_back(start, divide - start);
+		}
+	}
+	if (!Nmisplaced)
+		return first + boundary;
+
+	// swaps [k0, k1) of the misplaced pairs
+	auto swap_misplaced = [&](size_t k0, size_t k1) {
+		size_t false_segment = 0;
+		size_t true_segment = 0;
+		size_t false_offset = k0;
+		size_t true_offset = k0;
+		while (false_offset >= misplaced_false[false_segment].second)
+			false_offset -= misplaced_false[false_segment++].second;
+		while (true_offset >= misplaced_true[true_segment].second)
+			true_offset -= misplaced_true[true_segment++].second;
+		for (size_t k = k0; k < k1; ++k) {
+			std::iter_swap(
+					first + misplaced_false[false_segment].first + false_offset,
+					first + misplaced_true[true_segment].first + true_offset);
+			if (++false_offset == misplaced_false[false_segment].second) {
+				++false_segment;
+				false_offset = 0;
+			}
+			if (++true_offset == misplaced_true[true_segment].second) {
+				++true_segment;
+				true_offset = 0;
+			}
+		}
+	};
+	const size_t Ntasks = std::min(Nchunks, Nmisplaced);
+	run_tasks(pool, Ntasks, [&](size_t taskNo) {
+		const auto bounds = chunk_bounds(Nmisplaced, Ntasks, taskNo);
+		swap_misplaced(bounds.first, bounds.second);
+	});
+	return first + boundary;
+}
+
+// Stable partition on an existing pool: per-chunk counting, prefix sums of the
+// counts, scatter into a buffer and a parallel move back. The value type must
+// be default constructible.
+template<typename Iterator, typename Predicate>
+Iterator parallel_stable_partition(thread_pool &pool, Iterator first,
+		Iterator last, Predicate pred, size_t Nchunks) {
+	typedef typename std::iterator_traits<Iterator>::value_type T;
+
+	// number of elements
+	const size_t Nelements = std::distance(first, last);
+	if (Nchunks > Nelements)
+		Nchunks = Nelements;
+	if (Nchunks < 2)
+		return std::stable_partition(first, last, pred);
+
+	// counting (the predicate is evaluated once per element)
+	std::vector<unsigned char> flags(Nelements);
+	std::vector<size_t> Ntrue(Nchunks);
+	run_tasks(pool, Nchunks, [&](size_t chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nchunks, chunkNo);
+		size_t count = 0;
+		for (size_t i = bounds.first; i < bounds.second; ++i)
+			count += flags[i] = pred(first[i]) ? 1 : 0;
+		Ntrue[chunkNo] = count;
+	});
+
+	// offsets of the true and false elements of every chunk
+	std::vector<size_t> true_offsets(Nchunks);
+	std::vector<size_t> false_offsets(Nchunks);
+	size_t boundary = 0;
+	for (size_t chunkNo = 0; chunkNo < Nchunks; ++chunkNo) {
+		true_offsets[chunkNo] = boundary;
+		boundary += Ntrue[chunkNo];
+	}
+	size_t false_offset = boundary;
+	for (size_t chunkNo = 0; chunkNo < Nchunks; ++chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nchunks, chunkNo);
+		false_offsets[chunkNo] = false_offset;
+		false_offset += bounds.second - bounds.first - Ntrue[chunkNo];
+	}
+
+	// scatter into the buffer, move back
+	std::vector<T> buffer(Nelements);
+	run_tasks(pool, Nchunks, [&](size_t chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nchunks, chunkNo);
+		size_t true_index = true_offsets[chunkNo];
+		size_t false_index = false_offsets[chunkNo];
+		for (size_t i = bounds.first; i < bounds.second; ++i)
+			buffer[flags[i] ? true_index++ : false_index++] = std::move(
+					first[i]);
+	});
+	run_tasks(pool, Nchunks, [&](size_t chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nchunks, chunkNo);
+		std::move(buffer.begin() + bounds.first, buffer.begin() + bounds.second,
+				first + bounds.first);
+	});
+	return first + boundary;
+}
+
+// Copies the elements satisfying pred (in order) on an existing pool:
+// per-chunk counting, prefix sums of the counts and a parallel scatter
+template<typename InputIterator, typename OutputIterator, typename Predicate>
+OutputIterator parallel_copy_if(thread_pool &pool, InputIterator first,
+		InputIterator last, OutputIterator d_first, Predicate pred,
+		size_t Nchunks) {
+
+	// number of elements
+	const size_t Nelements = std::distance(first, last);
+	if (Nchunks > Nelements)
+		Nchunks = Nelements;
+	if (Nchunks < 2)
+		return std::copy_if(first, last, d_first, pred);
+
+	// counting (the predicate is evaluated once per element)
+	std::vector<unsigned char> flags(Nelements);
+	std::vector<size_t> offsets(Nchunks + 1, 0);
+	run_tasks(pool, Nchunks, [&](size_t chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nchunks, chunkNo);
+		size_t count = 0;
+		for (size_t i = bounds.first; i < bounds.second; ++i)
+			count += flags[i] = pred(first[i]) ? 1 : 0;
+		offsets[chunkNo + 1] = count;
+	});
+	for (size_t chunkNo = 0; chunkNo < Nchunks; ++chunkNo)
+		offsets[chunkNo + 1] += offsets[chunkNo];
+
+	// scatter
+	run_tasks(pool, Nchunks, [&](size_t chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nchunks, chunkNo);
+		OutputIterator out = d_first + offsets[chunkNo];
+		for (size_t i = bounds.first; i < bounds.second; ++i)
+			if (flags[i])
+				*out++ = first[i];
+	});
+	return d_first + offsets[Nchunks];
+}
+
+template<typename Iterator, typename Predicate>
+Iterator parallel_partition(Iterator first, Iterator last, Predicate pred,
+		size_t Nthreads = 2) {
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+
+	thread_pool pool(Nthreads - 1);
+	return parallel_partition(pool, first, last, pred, Nthreads);
+}
+
+template<typename Iterator, typename Predicate>
+Iterator parallel_stable_partition(Iterator first, Iterator last,
+		Predicate pred, size_t Nthreads = 2) {
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+
+	thread_pool pool(Nthreads - 1);
+	return parallel_stable_partition(pool, first, last, pred, Nthreads);
+}
+
+// Output iterators must be random access
+template<typename InputIterator, typename OutputIterator, typename Predicate>
+OutputIterator parallel_copy_if(InputIterator first, InputIterator last,
+		OutputIterator d_first, Predicate pred, size_t Nthreads = 2) {
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+
+	thread_pool pool(Nthreads - 1);
+	return parallel_copy_if(pool, first, last, d_first, pred, Nthreads);
+}
+
+#endif /* PARALLEL_PARTITION_H_ */
@@ -0,0 +1,194 @@
+/*
+ * parallel_select.h
+ *
+ * Multithreaded selection algorithms (top_k, nth_element, partial_sort)
+ *
+ */
+
+#ifndef PARALLEL_SELECT_H_
+#define PARALLEL_SELECT_H_
+
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <thread>
+#include "thread_pool.h"
+#include "parallel_partition.h"
+#include "parallel_sort.h"
+
+// ranges up to this size are finished serially by parallel_nth_element
+constexpr size_t kSerialSelectSize = 1 << 16;
+
+// number of elements sampled to choose the pivots of parallel_nth_element
+constexpr size_t kSelectSamples = 1024;
+
+// Collects the k greatest elements of [first, last) into a bounded heap (the
+// smallest retained element at the front)
+template<typename Iterator, typename Compare>
+std::vector<typename std::iterator_traits<Iterator>::value_type> top_k_chunk(
+		Iterator first, Iterator last, size_t k, Compare comp) {
+	typedef typename std::iterator_traits<Iterator>::value_type T;
+	auto greater = [&comp](const T &a, const T &b) {
+		return comp(b, a);
+	};
+	std::vector<T> heap;
+	heap.reserve(k);
+	for (; first != last && heap.size() < k; ++first) {
+		heap.push_back(*first);
+		std::push_heap(heap.begin(), heap.end(), greater);
+	}
+	for (; first != last; ++first) {
+		if (comp(heap.front(), *first)) {
+			std::pop_heap(heap.begin(), heap.end(), greater);
+			heap.back() = *first;
+			std::push_heap(heap.begin(), heap.end(), greater);
+		}
+	}
+	return heap;
+}
+
+// Returns the k greatest elements of [first, last) (with respect to comp) in
+// descending order, in a single pass: every thread keeps a bounded heap of its
+// chunk, the heaps are merged at the end. Meant for small k, requires random
+// access iterators.
+template<typename Iterator,
+		typename Compare = std::less<
+				typename std::iterator_traits<Iterator>::value_type>>
+std::vector<typename std::iterator_traits<Iterator>::value_type> parallel_top_k(
+		Iterator first, Iterator last, size_t k, size_t Nthreads = 2,
+		Compare comp = Compare()) {
+	typedef typename std::iterator_traits<Iterator>::value_type T;
+
+	// number of elements
+	const size_t Nelements = std::distance(first, last);
+	if (k > Nelements)
+		k = Nelements;
+	if (!k)
+		return std::vector<T>();
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+
+	// start thread pool
+	thread_pool pool(Nthreads - 1);
+
+	// vector of futures
+	std::vector<std::future<std::vector<T>>> future_results(Nthreads - 1);
+
+	// all chunks except the last one
+	for (size_t chunkNo = 0; chunkNo < Nthreads - 1; ++chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nthreads, chunkNo);
+		Iterator start = first + bounds.first;
+		Iterator stop = first + bounds.second;
+		future_results[chunkNo] = pool.submit(
+				[start, stop, k, comp]() -> std::vector<T> {
+					return top_k_chunk(start, stop, k, comp);
+				});
+	}
+
+	// final chunk
+	std::vector<T> result = top_k_chunk(
+			first + chunk_bounds(Nelements, Nthreads, Nthreads - 1).first,
+			last, k, comp);
+
+	// merge the heaps
+	for (auto &future_result : future_results) {
+		std::vector<T> heap = future_result.get();
+		result.insert(result.end(), heap.begin(), heap.end());
+	}
+	std::partial_sort(result.begin(), result.begin() + k, result.end(),
+			[&comp](const T &a, const T &b) {
+				return comp(b, a);
+			});
+	result.resize(k);
+	return result;
+}
+
+// Quickselect on an existing pool: two pivots bracketing the rank of nth are
+// taken from a regular sample of the range, the range is split into the
+// elements below, between and above them by parallel partitions and the search
+// continues in the part holding nth
+template<typename Iterator, typename Compare>
+void parallel_nth_element(thread_pool &pool, Iterator first, Iterator nth,
+		Iterator last, Compare comp, size_t Nthreads) {
+	typedef typename std::iterator_traits<Iterator>::value_type T;
+
+	while ((size_t) std::distance(first, last) > kSerialSelectSize) {
+		const size_t Nelements = std::distance(first, last);
+
+		// regular sample, pivots around the relative rank of nth
+		std::vector<T> samples(kSelectSamples);
+		for (size_t sampleNo = 0; sampleNo < kSelectSamples; ++sampleNo)
+			samples[sampleNo] = first[Nelements / kSelectSamples * sampleNo];
+		const size_t rank = (nth - first) * kSelectSamples / Nelements;
+		const size_t margin = 16;
+		const size_t lo_rank = rank > margin ? rank - margin : 0;
+		const size_t hi_rank = std::min(rank + margin, kSelectSamples - 1);
+		std::nth_element(samples.begin(), samples.begin() + lo_rank,
+				samples.end(), comp);
+		const T lo = samples[lo_rank];
+		std::nth_element(samples.begin() + lo_rank, samples.begin() + hi_rank,
+				samples.end(), comp);
+		const T hi = samples[hi_rank];
+
+		// [first, lower) < lo, [lower, upper) in [lo, hi], [upper, last) > hi
+		Iterator lower = parallel_partition(pool, first, last,
+				[&](const T &val) {
+					return comp(val, lo);
+				}, Nthreads);
+		if (nth < lower) {
+			last = lower;
+			continue;
+		}
+		Iterator upper = parallel_partition(pool, lower, last,
+				[&](const T &val) {
+					return !comp(hi, val);
+				}, Nthreads);
+		if (nth >= upper) {
+			first = upper;
+			continue;
+		}
+		if (lower == first && upper == last)
+			break; // no progress (heavy duplicates), finish serially
+		first = lower;
+		last = upper;
+	}
+	std::nth_element(first, nth, last, comp);
+}
+
+// Rearranges [first, last) like std::nth_element, requires random access iterators
+template<typename Iterator,
+		typename Compare = std::less<
+				typename std::iterator_traits<Iterator>::value_type>>
+void parallel_nth_element(Iterator first, Iterator nth, Iterator last,
+		size_t Nthreads = 2, Compare comp = Compare()) {
+	if (nth == last)
+		return;
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+
+	thread_pool pool(Nthreads - 1);
+	parallel_nth_element(pool, first, nth, last, comp, Nthreads);
+}
+
+// Rearranges [first, last) like std::partial_sort: selection of the middle - first
+// smallest elements followed by a parallel sort of them
+template<typename Iterator,
+		typename Compare = std::less<
+				typename std::iterator_traits<Iterator>::value_type>>
+void parallel_partial_sort(Iterator first, Iterator middle, Iterator last,
+		size_t Nthreads = 2, Compare comp = Compare()) {
+	if (first == middle)
+		return;
+	parallel_nth_element(first, middle - 1, last, Nthreads, comp);
+	parallel_sort(first, middle - 1, Nthreads, comp);
+}
+
+#endif /* PARALLEL_SELECT_H_ */
@@ -16,7 +16,19 @@
 #include <utility>
 #include <iterator>
 #include <algorithm>
+#include <functional>
 #include "thread_pool.h"
+#include "parallel_partition.h"
+
+// ranges up to this size are sorted serially by sorter_range
+constexpr size_t kSerialSortSize = 1 << 13;
+
+// ranges from this size on are partitioned in parallel by sorter_range
+constexpr size_t kParallelPartitionSize = 1 << 18;
+
+// merges of two runs are split into parts of at least this many elements by
+// parallel_stable_sort
+constexpr size_t kMinMergePartSize = 1 << 14;
 
 template<typename T>
 class sorter_list {
@@ -76,4 +88,259 @@ std::list<T> parallel_sort(std::list<T> input, size_t Nthreads = 2) {
 	return s.do_sort(input);
 }
 
+// Quicksort of a contiguous range: the large ranges at the top of the recursion
+// are partitioned in parallel, the smaller ones serially, and the lower part of
+// every partition is sorted by the pool
+template<typename Iterator, typename Compare>
+class sorter_range {
+public:
+	sorter_range(thread_pool &pool, size_t Nthreads, Compare comp) :
+			pool(pool), Nthreads(Nthreads), comp(comp) {
+	}
+
+	~sorter_range() = default;
+
+	void do_sort(Iterator first, Iterator last) {
+		typedef typename std::iterator_traits<Iterator>::value_type T;
+
+		const size_t Nelements = std::distance(first, last);
+		if (Nelements <= kSerialSortSize) {
+			std::sort(first, last, comp);
+			return;
+		}
+
+		// median of three
+		Iterator middle = first + Nelements / 2;
+		const T &a = *first;
+		const T &b = *middle;
+		const T &c = *(last - 1);
+		const T partition_val =
+				comp(a, b) ?
+						(comp(b, c) ? b : (comp(a, c) ? c : a)) :
+						(comp(a, c) ? a : (comp(b, c) ? c : b));
+
+		// three-way split: [first, lower) < pivot, [lower, upper) == pivot,
+		// [upper, last) > pivot
+		auto less = [&](const T &val) {
+			return comp(val, partition_val);
+		};
+		auto not_greater = [&](const T &val) {
+			return !comp(partition_val, val);
+		};
+		Iterator lower, upper;
+		if (Nelements >= kParallelPartitionSize && Nthreads > 1) {
+			lower = parallel_partition(pool, first, last, less, Nthreads);
+			upper = parallel_partition(pool, lower, last, not_greater,
+					Nthreads);
+		} else {
+			lower = std::partition(first, last, less);
+			upper = std::partition(lower, last, not_greater);
+		}
+
+		std::future<void> new_lower = pool.submit([this, first, lower]() {
+			do_sort(first, lower);
+		});
+
+		do_sort(upper, last);
+		while (new_lower.wait_for(std::chrono::seconds(0))
+				!= std::future_status::ready) {
+			pool.run_pending_task();
+		}
+		new_lower.get();
+	}
+private:
+	thread_pool &pool;
+	const size_t Nthreads;
+	Compare comp;
+};
+
+// Sorts [first, last) in place on an existing pool, requires random access
+// iterators
+template<typename Iterator, typename Compare>
+void parallel_sort(thread_pool &pool, Iterator first, Iterator last,
+		Compare comp, size_t Nthreads) {
+	if (first == last) {
+		return;
+	}
+
+	sorter_range<Iterator, Compare> s(pool, Nthreads, comp);
+	s.do_sort(first, last);
+}
+
+// Sorts [first, last) in place, requires random access iterators
+template<typename Iterator,
+		typename Compare = std::less<
+				typename std::iterator_traits<Iterator>::value_type>>
+void parallel_sort(Iterator first, Iterator last, size_t Nthreads = 2,
+		Compare comp = Compare()) {
+	if (first == last) {
+		return;
+	}
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+
+	thread_pool pool(Nthreads - 1);
+	parallel_sort(pool, first, last, comp, Nthreads);
+}
+
+// Stable sort of a list: the list is split into one sublist per thread, the
+// sublists are sorted by list::sort and merged pairwise by list::merge (both
+// stable) in a tree, the merges of one level run in parallel
+template<typename T, typename Compare = std::less<T>>
+std::list<T> parallel_stable_sort(std::list<T> input, size_t Nthreads = 2,
+		Compare comp = Compare()) {
+	if (input.empty()) {
+		return input;
+	}
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+	const size_t Nelements = input.size();
+	if (Nthreads > Nelements)
+		Nthreads = Nelements;
+
+	// split
+	std::vector<std::list<T>> chunks(Nthreads);
+	for (size_t chunkNo = 0; chunkNo < Nthreads - 1; ++chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nthreads, chunkNo);
+		typename std::list<T>::iterator stop = input.begin();
+		std::advance(stop, bounds.second - bounds.first);
+		chunks[chunkNo].splice(chunks[chunkNo].end(), input, input.begin(),
+				stop);
+	}
+	chunks[Nthreads - 1].swap(input);
+
+	// sort the chunks, merge tree
+	thread_pool pool(Nthreads - 1);
+	run_tasks(pool, Nthreads, [&](size_t chunkNo) {
+		chunks[chunkNo].sort(comp);
+	});
+	for (size_t width = 1; width < Nthreads; width *= 2) {
+		const size_t Npairs = (Nthreads - width + 2 * width - 1) / (2 * width);
+		run_tasks(pool, Npairs, [&](size_t pairNo) {
+			const size_t chunkNo = pairNo * 2 * width;
+			chunks[chunkNo].merge(chunks[chunkNo + width], comp);
+		});
+	}
+	return std::move(chunks[0]);
+}
+
+// Number of elements of the sorted run a among the first k elements of the
+// stable merge of the sorted runs a and b (ties are taken from a first)
+template<typename Iterator, typename Compare>
+size_t merge_path_split(Iterator a, size_t Na, Iterator b, size_t Nb, size_t k,
+		Compare comp) {
+	size_t lo = k > Nb ? k - Nb : 0;
+	size_t hi = std::min(k, Na);
+	while (lo < hi) {
+		const size_t i = (lo + hi) / 2;
+		const size_t j = k - i;
+		if (j > 0 && !comp(b[j - 1], a[i]))
+			lo = i + 1;
+		else
+			hi = i;
+	}
+	return lo;
+}
+
+// Stable sort of a contiguous range: one chunk per thread is sorted by
+// std::stable_sort, then adjacent runs are merged pairwise in a tree, ping-ponging
+// between the range and a buffer. Every merge is split into independent parts
+// along the merge path, so the top levels of the tree keep all threads busy.
+// Requires random access iterators and a default constructible value type.
+template<typename Iterator,
+		typename Compare = std::less<
+				typename std::iterator_traits<Iterator>::value_type>>
+void parallel_stable_sort(Iterator first, Iterator last, size_t Nthreads = 2,
+		Compare comp = Compare()) {
+	typedef typename std::iterator_traits<Iterator>::value_type T;
+
+	// number of elements
+	const size_t Nelements = std::distance(first, last);
+	if (!Nelements) {
+		return;
+	}
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+	if (Nthreads > Nelements)
+		Nthreads = Nelements;
+
+	// sort the chunks
+	thread_pool pool(Nthreads - 1);
+	run_tasks(pool, Nthreads, [&](size_t chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nthreads, chunkNo);
+		std::stable_sort(first + bounds.first, first + bounds.second, comp);
+	});
+	if (Nthreads == 1)
+		return;
+
+	// run boundaries
+	std::vector<size_t> runs(Nthreads + 1);
+	for (size_t chunkNo = 0; chunkNo <= Nthreads; ++chunkNo)
+		runs[chunkNo] = Nelements * chunkNo / Nthreads;
+
+	// merge tree, the runs of one level are merged from src into dst
+	std::unique_ptr<T[]> buffer(new T[Nelements]);
+	bool in_buffer = false;
+	while (runs.size() > 2) {
+		const size_t Nruns = runs.size() - 1;
+		const size_t Npairs = (Nruns + 1) / 2;
+		const size_t Nparts = std::max<size_t>(1,
+				std::min(Nthreads / Npairs,
+						Nelements / Npairs / kMinMergePartSize));
+		auto merge_part = [&](auto src, auto dst, size_t taskNo) {
+			const size_t pairNo = taskNo / Nparts;
+			const size_t partNo = taskNo % Nparts;
+			const size_t start = runs[2 * pairNo];
+			const size_t middle = runs[std::min(2 * pairNo + 1, Nruns)];
+			const size_t stop = runs[std::min(2 * pairNo + 2, Nruns)];
+
+			// part [k0, k1) of the merged output
+			const size_t k0 = (stop - start) * partNo / Nparts;
+			const size_t k1 = (stop - start) * (partNo + 1) / Nparts;
+			const size_t i0 = merge_path_split(src + start, middle - start,
+					src + middle, stop - middle, k0, comp);
+			const size_t i1 = merge_path_split(src + start, middle - start,
+					src + middle, stop - middle, k1, comp);
+			std::merge(std::make_move_iterator(src + start + i0),
+					std::make_move_iterator(src + start + i1),
+					std::make_move_iterator(src + middle + k0 - i0),
+					std::make_move_iterator(src + middle + k1 - i1),
+					dst + start + k0, comp);
+		};
+		if (in_buffer)
+			run_tasks(pool, Npairs * Nparts, [&](size_t taskNo) {
+				merge_part(buffer.get(), first, taskNo);
+			});
+		else
+			run_tasks(pool, Npairs * Nparts, [&](size_t taskNo) {
+				merge_part(first, buffer.get(), taskNo);
+			});
+		in_buffer = !in_buffer;
+
+		// boundaries of the merged runs
+		std::vector<size_t> merged_runs;
+		for (size_t runNo = 0; runNo < Nruns; runNo += 2)
+			merged_runs.push_back(runs[runNo]);
+		merged_runs.push_back(Nelements);
+		runs.swap(merged_runs);
+	}
+
+	// move back
+	if (in_buffer)
+		run_tasks(pool, Nthreads, [&](size_t chunkNo) {
+			const auto bounds = chunk_bounds(Nelements, Nthreads, chunkNo);
+			std::move(buffer.get() + bounds.first, buffer.get() + bounds.second,
+					first + bounds.first);
+		});
+}
+
 #endif /* PARALLEL_SORT_H_ */
@@ -0,0 +1,195 @@
+/*
+ * parallel_sort_by_key.h
+ *
+ * Multithreaded argsort, sort-by-key and indirect sort algorithms (large
+ * payloads are moved once, after the keys have been sorted)
+ *
+ */
+
+#ifndef PARALLEL_SORT_BY_KEY_H_
+#define PARALLEL_SORT_BY_KEY_H_
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <thread>
+#include "thread_pool.h"
+#include "parallel_partition.h"
+#include "parallel_sort.h"
+
+// number of elements per block of the gather (the sources of the next block
+// are prefetched while the current block is copied)
+constexpr size_t kGatherBlockSize = 64;
+
+// Stable sorting permutation of Nelements keys on an existing pool (key_at(i)
+// is the key of element i): (key, index) pairs are built, sorted by key (ties
+// by index) and the indices extracted
+template<typename Key, typename KeyAt, typename Compare>
+std::vector<size_t> sorting_permutation(thread_pool &pool, size_t Nelements,
+		KeyAt key_at, size_t Nthreads, Compare comp) {
+	std::vector<std::pair<Key, size_t>> pairs(Nelements);
+	run_tasks(pool, Nthreads, [&](size_t chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nthreads, chunkNo);
+		for (size_t i = bounds.first; i < bounds.second; ++i)
+			pairs[i] = std::make_pair(key_at(i), i);
+	});
+
+	parallel_sort(pool, pairs.begin(), pairs.end(),
+			[comp](const std::pair<Key, size_t> &a,
+					const std::pair<Key, size_t> &b) {
+				if (comp(a.first, b.first))
+					return true;
+				if (comp(b.first, a.first))
+					return false;
+				return a.second < b.second;
+			}, Nthreads);
+
+	std::vector<size_t> perm(Nelements);
+	run_tasks(pool, Nthreads, [&](size_t chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nthreads, chunkNo);
+		for (size_t i = bounds.first; i < bounds.second; ++i)
+			perm[i] = pairs[i].second;
+	});
+	return perm;
+}
+
+// Cache-blocked gather on an existing pool: d_first[i] = move(src[perm[i]])
+template<typename Iterator, typename OutputIterator>
+void parallel_gather(thread_pool &pool, Iterator src, const size_t *perm,
+		OutputIterator d_first, size_t Nelements, size_t Nchunks) {
+	if (!Nelements)
+		return;
+	if (Nchunks > Nelements)
+		Nchunks = Nelements;
+	run_tasks(pool, Nchunks, [&](size_t chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nchunks, chunkNo);
+		for (size_t start = bounds.first; start < bounds.second;
+				start += kGatherBlockSize) {
+			const size_t stop = std::min(start + kGatherBlockSize, bounds.second);
+			const size_t next_stop = std::min(stop + kGatherBlockSize,
+					bounds.second);
+			for (size_t i = stop; i < next_stop; ++i)
+				__builtin_prefetch(&*(src + perm[i]));
+			for (size_t i = start; i < stop; ++i)
+				d_first[i] = std::move(src[perm[i]]);
+		}
+	});
+}
+
+// Reorders [first, first + perm.size()) so that element i becomes the element at
+// perm[i] (gather into a buffer, parallel move back). The value type must be
+// default constructible; the buffer is default-initialised, so for trivial types
+// it is first touched by the parallel gather rather than zeroed serially.
+template<typename Iterator>
+void parallel_apply_permutation(thread_pool &pool, Iterator first,
+		const std::vector<size_t> &perm, size_t Nchunks) {
+	typedef typename std::iterator_traits<Iterator>::value_type T;
+	const size_t Nelements = perm.size();
+	if (Nchunks > Nelements)
+		Nchunks = Nelements;
+	if (!Nchunks)
+		return;
+
+	std::unique_ptr<T[]> buffer(new T[Nelements]);
+	parallel_gather(pool, first, perm.data(), buffer.get(), Nelements,
+			Nchunks);
+	run_tasks(pool, Nchunks, [&](size_t chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nchunks, chunkNo);
+		std::move(buffer.get() + bounds.first, buffer.get() + bounds.second,
+				first + bounds.first);
+	});
+}
+
+// Returns the stable sorting permutation of [first, last): element i of the
+// sorted range is first[result[i]]. Requires random access iterators.
+template<typename Iterator,
+		typename Compare = std::less<
+				typename std::iterator_traits<Iterator>::value_type>>
+std::vector<size_t> parallel_argsort(Iterator first, Iterator last,
+		size_t Nthreads = 2, Compare comp = Compare()) {
+	typedef typename std::iterator_traits<Iterator>::value_type Key;
+
+	// number of elements
+	const size_t Nelements = std::distance(first, last);
+	if (!Nelements)
+		return std::vector<size_t>();
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+
+	thread_pool pool(Nthreads - 1);
+	return sorting_permutation<Key>(pool, Nelements, [first](size_t i) {
+		return first[i];
+	}, Nthreads, comp);
+}
+
+// Sorts the keys [keys_first, keys_last) and permutes the values starting at
+// values_first along with them (stable). Only (key, index) pairs are moved by
+// the sort, every value is moved once by the final gather. Requires random
+// access iterators and default constructible keys and values.
+template<typename KeyIterator, typename ValueIterator,
+		typename Compare = std::less<
+				typename std::iterator_traits<KeyIterator>::value_type>>
+void parallel_sort_by_key(KeyIterator keys_first, KeyIterator keys_last,
+		ValueIterator values_first, size_t Nthreads = 2, Compare comp =
+				Compare()) {
+	typedef typename std::iterator_traits<KeyIterator>::value_type Key;
+
+	// number of elements
+	const size_t Nelements = std::distance(keys_first, keys_last);
+	if (!Nelements)
+		return;
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+
+	// one pool for the permutation, the sort and the gathers
+	thread_pool pool(Nthreads - 1);
+	const std::vector<size_t> perm = sorting_permutation<Key>(pool, Nelements,
+			[keys_first](size_t i) {
+				return keys_first[i];
+			}, Nthreads, comp);
+
+	parallel_apply_permutation(pool, keys_first, perm, Nthreads);
+	parallel_apply_permutation(pool, values_first, perm, Nthreads);
+}
+
+// Sorts [first, last) by key_fn(element) (stable): the (key, index) pairs are
+// sorted and the permutation is applied to the elements once at the end. For
+// elements that are expensive to move. Requires random access iterators and
+// default constructible elements.
+template<typename Iterator, typename KeyFn>
+void parallel_sort_indirect(Iterator first, Iterator last, KeyFn key_fn,
+		size_t Nthreads = 2) {
+	typedef typename std::iterator_traits<Iterator>::value_type T;
+	typedef typename std::decay<typename std::result_of<KeyFn(const T&)>::type>::type Key;
+
+	// number of elements
+	const size_t Nelements = std::distance(first, last);
+	if (!Nelements)
+		return;
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+
+	// one pool for the permutation, the sort and the gather
+	thread_pool pool(Nthreads - 1);
+	const std::vector<size_t> perm = sorting_permutation<Key>(pool, Nelements,
+			[first, &key_fn](size_t i) {
+				return key_fn(first[i]);
+			}, Nthreads, std::less<Key>());
+
+	parallel_apply_permutation(pool, first, perm, Nthreads);
+}
+
+#endif /* PARALLEL_SORT_BY_KEY_H_ */
@@ -0,0 +1,229 @@
+/*
+ * parallel_string_sort.h
+ *
+ * Multithreaded string sort algorithm (multikey quicksort with character
+ * caching) with optional LCP array output
+ *
+ */
+
+#ifndef PARALLEL_STRING_SORT_H_
+#define PARALLEL_STRING_SORT_H_
+
+#include <list>
+#include <string>
+#include <vector>
+#include <future>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+#include "thread_pool.h"
+#include "parallel_partition.h"
+
+// ranges up to this size are finished by insertion sort
+constexpr size_t kStringInsertionSortSize = 32;
+
+// ranges from this size on are split between the threads
+constexpr size_t kParallelStringSortSize = 1 << 14;
+
+// number of characters per cache value
+constexpr size_t kCachedChars = 7;
+
+// Characters [depth, depth + kCachedChars) of s as a cache value: the unsigned
+// characters big-endian in the upper 7 bytes (zero padded), the number of
+// characters present in the lowest byte. Cache values order like the
+// substrings, equal values with fewer than kCachedChars characters mean equal
+// strings.
+inline uint64_t cached_chars(const std::string &s, size_t depth) {
+	const size_t Nchars =
+			depth < s.size() ? std::min(s.size() - depth, kCachedChars) : 0;
+	uint64_t value = 0;
+	for (size_t i = 0; i < Nchars; ++i)
+		value |= (uint64_t) (unsigned char) s[depth + i] << (56 - 8 * i);
+	return value | Nchars;
+}
+
+// Multikey quicksort of string pointers: the strings of a range are split
+// three ways on their characters at the current depth, which are kept in a
+// cache array next to the pointers and only re-read when the depth increases.
+// The lower and higher parts of the large ranges are handed to the pool.
+class sorter_string {
+public:
+	sorter_string(thread_pool &pool) :
+			pool(pool) {
+	}
+
+	~sorter_string() = default;
+
+	// strings[i] and cache[i] (characters of *strings[i] at depth) for [0, Nelements)
+	void do_sort(const std::string **strings, uint64_t *cache, size_t Nelements,
+			size_t depth) {
+		std::vector<std::future<void>> future_results;
+
+		while (Nelements > kStringInsertionSortSize) {
+
+			// median of three
+			const uint64_t a = cache[0];
+			const uint64_t b = cache[Nelements / 2];
+			const uint64_t c = cache[Nelements - 1];
+			const uint64_t pivot =
+					a < b ? (b < c ? b : (a < c ? c : a)) :
+							(a < c ? a : (b < c ? c : b));
+
+			// three-way split: [0, lt) < pivot, [lt, gt) == pivot, [gt, Nelements) > pivot
+			size_t lt = 0;
+			size_t gt = Nelements;
+			for (size_t i = 0; i < gt;) {
+				if (cache[i] < pivot) {
+					std::swap(cache[i], cache[lt]);
+					std::swap(strings[i++], strings[lt++]);
+				} else if (cache[i] > pivot) {
+					--gt;
+					std::swap(cache[i], cache[gt]);
+					std::swap(strings[i], strings[gt]);
+				} else
+					++i;
+			}
+
+			// lower and higher parts: same depth
+			sort_part(strings, cache, lt, depth, future_results);
+			sort_part(strings + gt, cache + gt, Nelements - gt, depth,
+					future_results);
+
+			// equal part: next depth (done if the strings ended)
+			if ((pivot & 0xff) < kCachedChars) {
+				Nelements = 0;
+				break;
+			}
+			strings += lt;
+			cache += lt;
+			Nelements = gt - lt;
+			depth += kCachedChars;
+			for (size_t i = 0; i < Nelements; ++i)
+				cache[i] = cached_chars(*strings[i], depth);
+		}
+		insertion_sort(strings, cache, Nelements, depth);
+
+		for (auto &future_result : future_results) {
+			while (future_result.wait_for(std::chrono::seconds(0))
+					!= std::future_status::ready) {
+				pool.run_pending_task();
+			}
+			future_result.get();
+		}
+	}
+private:
+	void sort_part(const std::string **strings, uint64_t *cache,
+			size_t Nelements, size_t depth,
+			std::vector<std::future<void>> &future_results) {
+		if (Nelements >= kParallelStringSortSize)
+			future_results.push_back(
+					pool.submit([this, strings, cache, Nelements, depth]() {
+						do_sort(strings, cache, Nelements, depth);
+					}));
+		else if (Nelements > 1)
+			do_sort(strings, cache, Nelements, depth);
+	}
+
+	// strings are equal up to depth, compared from there on
+	static void insertion_sort(const std::string **strings, uint64_t *cache,
+			size_t Nelements, size_t depth) {
+		for (size_t i = 1; i < Nelements; ++i) {
+			const std::string *s = strings[i];
+			const uint64_t c = cache[i];
+			size_t j = i;
+			for (; j > 0 && less_from(*s, *strings[j - 1], depth); --j) {
+				strings[j] = strings[j - 1];
+				cache[j] = cache[j - 1];
+			}
+			strings[j] = s;
+			cache[j] = c;
+		}
+	}
+
+	static bool less_from(const std::string &a, const std::string &b,
+			size_t depth) {
+		return a.compare(depth, std::string::npos, b, depth, std::string::npos)
+				< 0;
+	}
+
+	thread_pool &pool;
+};
+
+// Longest common prefix of every sorted string with its predecessor (lcp[0] = 0)
+template<typename Iterator>
+void parallel_lcp(thread_pool &pool, Iterator first, size_t Nelements,
+		std::vector<size_t> &lcp, size_t Nchunks) {
+	lcp.assign(Nelements, 0);
+	if (Nchunks > Nelements)
+		Nchunks = Nelements;
+	if (!Nchunks)
+		return;
+	run_tasks(pool, Nchunks, [&](size_t chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nchunks, chunkNo);
+		for (size_t i = std::max<size_t>(bounds.first, 1); i < bounds.second;
+				++i) {
+			const std::string &a = first[i - 1];
+			const std::string &b = first[i];
+			const size_t Nchars = std::min(a.size(), b.size());
+			lcp[i] = std::mismatch(a.begin(), a.begin() + Nchars, b.begin()).first
+					- a.begin();
+		}
+	});
+}
+
+// Sorts the strings in place (same order as std::sort), fills lcp with the
+// longest common prefix of every sorted string and its predecessor if given
+inline void parallel_string_sort(std::vector<std::string> &strings,
+		size_t Nthreads = 2, std::vector<size_t> *lcp = nullptr) {
+
+	// number of elements
+	const size_t Nelements = strings.size();
+
+	// max number of hardware threads
+	const size_t NthreadsMax = std::thread::hardware_concurrency();
+	if (Nthreads > NthreadsMax)
+		Nthreads = NthreadsMax;
+
+	// start thread pool
+	thread_pool pool(Nthreads - 1);
+	const size_t Nchunks = std::max<size_t>(1, std::min(Nthreads, Nelements));
+
+	// pointers and first characters
+	std::vector<const std::string*> pointers(Nelements);
+	std::vector<uint64_t> cache(Nelements);
+	run_tasks(pool, Nchunks, [&](size_t chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nchunks, chunkNo);
+		for (size_t i = bounds.first; i < bounds.second; ++i) {
+			pointers[i] = &strings[i];
+			cache[i] = cached_chars(strings[i], 0);
+		}
+	});
+
+	sorter_string s(pool);
+	s.do_sort(pointers.data(), cache.data(), Nelements, 0);
+
+	// move the strings into sorted order (a string move only swaps buffers)
+	std::vector<std::string> sorted(Nelements);
+	run_tasks(pool, Nchunks, [&](size_t chunkNo) {
+		const auto bounds = chunk_bounds(Nelements, Nchunks, chunkNo);
+		for (size_t i = bounds.first; i < bounds.second; ++i)
+			sorted[i] = std::move(*const_cast<std::string*>(pointers[i]));
+	});
+	strings.swap(sorted);
+
+	if (lcp)
+		parallel_lcp(pool, strings.begin(), Nelements, *lcp, Nthreads);
+}
+
+inline std::list<std::string> parallel_string_sort(
+		std::list<std::string> input, size_t Nthreads = 2,
+		std::vector<size_t> *lcp = nullptr) {
+	std::vector<std::string> strings(std::make_move_iterator(input.begin()),
+			std::make_move_iterator(input.end()));
+	parallel_string_sort(strings, Nthreads, lcp);
+	std::move(strings.begin(), strings.end(), input.begin());
+	return input;
+}
+
+#endif /* PARALLEL_STRING_SORT_H_ */
@@ -13,6 +13,7 @@
 #include <memory> // std::unique_ptr
 #include <list> // std::list
 #include <utility> // std::move
+#include <iterator> // std::next
 #include <mutex> // std::mutex, std::lock_guard, std::unique_lock
 #include <condition_variable> // std::condition_variable
 #include <exception> // std::exception
@@ -20,7 +21,14 @@
 template<typename Element>
 class ThreadSafeQueue1 {
 	typedef std::unique_ptr<Element> ElementPtr;
-	typedef std::list<ElementPtr> Container;
+	typedef std::list<ElementPtr> Container; // also the type of a batch
+
+	// gives access to the oldest elements, which a thief takes first
+	struct Queue: public std::queue<ElementPtr, Container> {
+		Container& elements() {
+			return this->c;
+		}
+	};
 
 	struct EmptyQueue: public std::exception {
 		virtual const char* what() const noexcept (true) override {
@@ -43,10 +51,12 @@ public:
 	void emplace(Ts &&... pars);
 	ElementPtr waitPop();
 	ElementPtr tryPop();
+	size_t tryStealHalf(Container &batch);
+	void pushBatch(Container &batch);
 private:
 	mutable std::mutex m_mutex;
 	std::condition_variable m_cond;
-	std::queue<ElementPtr, Container> m_queue;
+	Queue m_queue;
 };
 
 template<typename Element>
@@ -122,4 +132,26 @@ typename ThreadSafeQueue1<Element>::ElementPtr ThreadSafeQueue1<Element>::tryPop
 	return front_element;
 }
 
+// moves the list nodes of the older half of the elements (rounded up) to the
+// back of batch, oldest first, returns their number
+template<typename Element>
+size_t ThreadSafeQueue1<Element>::tryStealHalf(Container &batch) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Container &elements = m_queue.elements();
+	const size_t Nstolen = (elements.size() + 1) / 2;
+	batch.splice(batch.end(), elements, elements.begin(),
+			std::next(elements.begin(), Nstolen));
+	return Nstolen;
+}
+
+// moves the list nodes of batch behind the newest element, in their order
+template<typename Element>
+void ThreadSafeQueue1<Element>::pushBatch(Container &batch) {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.elements().splice(m_queue.elements().end(), batch);
+	}
+	m_cond.notify_all();
+}
+
 #endif /* THREADSAFE_QUEUE1_H_ */
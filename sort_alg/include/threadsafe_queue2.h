@@ -3,6 +3,8 @@
  *
  * Lock-based thread-safe unbounded queue implemented using a singly-linked list,
  * locks, fined-tuned mutexes (front and back mutex), and a condition variable.
+ * The elements are stored in the nodes, which come from an allocation policy
+ * (plain new/delete by default, see node_pool.h).
  *
  */
 
@@ -10,16 +12,16 @@
 #define THREADSAFE_QUEUE2_H_
 
 #include <memory> // std::unique_ptr
-#include <utility> // std::move
+#include <utility> // std::move, std::forward
+#include <type_traits> // std::aligned_storage
 #include <mutex> // std::mutex, std::lock_guard, std::unique_lock
 #include <condition_variable> // std::condition_variable
 #include <exception> // std::exception
+#include "node_pool.h"
 
-template<typename Element>
+template<typename Element, typename Allocator = default_node_allocator>
 class ThreadSafeQueue2 {
 	typedef std::unique_ptr<Element> ElementPtr;
-	class Node; // forward declaration
-	typedef std::unique_ptr<Node> NodePtr;
 
 	struct EmptyQueue: public std::exception {
 		virtual const char* what() const noexcept (true) override {
@@ -27,20 +29,17 @@ class ThreadSafeQueue2 {
 		}
 	};
 
+	// the front node is a dummy node without an element
 	struct Node {
 		Node() :
-				m_data(nullptr), next(nullptr) {
-		}
-		Node(const Element &element) :
-				m_data(std::make_unique<Element>(element)), next(nullptr) {
-		}
-		Node(Element &&element) :
-				m_data(std::make_unique<Element>(std::move(element))), next(
-						nullptr) {
+				next(nullptr) {
 		}
 		~Node() = default;
-		ElementPtr m_data;
-		NodePtr next;
+		Element* data() {
+			return reinterpret_cast<Element*>(&m_data);
+		}
+		typename std::aligned_storage<sizeof(Element), alignof(Element)>::type m_data;
+		Node *next;
 	};
 public:
 	ThreadSafeQueue2();
@@ -58,93 +57,136 @@ public:
 	void emplace(Ts &&... pars);
 	ElementPtr waitPop();
 	ElementPtr tryPop();
+	bool tryPop(Element &element);
 private:
+	template<typename ...Ts>
+	void pushElement(Ts &&... pars);
+	Node* popNode();
+
 	mutable std::mutex m_mutex_front;
 	mutable std::mutex m_mutex_back;
 	std::condition_variable m_cond;
-	NodePtr m_node_front;
+	Node *m_node_front;
 	Node *m_node_back;
 };
 
-template<typename Element>
-ThreadSafeQueue2<Element>::ThreadSafeQueue2() :
-		m_node_front(std::make_unique<Node>()), m_node_back(m_node_front.get()) {
+template<typename Element, typename Allocator>
+ThreadSafeQueue2<Element, Allocator>::ThreadSafeQueue2() :
+		m_node_front(Allocator::template create<Node>()), m_node_back(
+				m_node_front) {
 }
 
-template<typename Element>
-ThreadSafeQueue2<Element>::~ThreadSafeQueue2() {
+template<typename Element, typename Allocator>
+ThreadSafeQueue2<Element, Allocator>::~ThreadSafeQueue2() {
+	Node *next = m_node_front->next;
+	Allocator::destroy(m_node_front);
+	while (next) {
+		Node *node = next;
+		next = node->next;
+		node->data()->~Element();
+		Allocator::destroy(node);
+	}
 }
 
-template<typename Element>
-const typename ThreadSafeQueue2<Element>::Node* ThreadSafeQueue2<Element>::getBackLabel() const {
+template<typename Element, typename Allocator>
+const typename ThreadSafeQueue2<Element, Allocator>::Node* ThreadSafeQueue2<
+		Element, Allocator>::getBackLabel() const {
 	std::lock_guard<std::mutex> lock_back(m_mutex_back);
 	return m_node_back;
 }
 
-template<typename Element>
-bool ThreadSafeQueue2<Element>::empty() const {
+template<typename Element, typename Allocator>
+bool ThreadSafeQueue2<Element, Allocator>::empty() const {
 	std::lock_guard<std::mutex> lock_front(m_mutex_front);
-	return !m_node_front->next;
+	return m_node_front == getBackLabel();
 }
 
-template<typename Element>
-void ThreadSafeQueue2<Element>::push(const Element &element) {
-	NodePtr new_node(std::make_unique<Node>(element));
-	Node *new_back = new_node.get();
+// builds the node outside the locks, then links it behind the back node
+template<typename Element, typename Allocator>
+template<typename ...Ts>
+void ThreadSafeQueue2<Element, Allocator>::pushElement(Ts &&... pars) {
+	Node *new_node = Allocator::template create<Node>();
+	try {
+		new (new_node->data()) Element(std::forward<Ts>(pars)...);
+	} catch (...) {
+		Allocator::destroy(new_node);
+		throw;
+	}
 	{
 		std::lock_guard<std::mutex> lock_back(m_mutex_back);
-		m_node_back->m_data = std::move(new_node->m_data);
-		m_node_back->next = std::move(new_node);
-		m_node_back = new_back;
+		m_node_back->next = new_node;
+		m_node_back = new_node;
 	}
 	m_cond.notify_one();
 }
 
-template<typename Element>
-void ThreadSafeQueue2<Element>::push(Element &&element) {
-	NodePtr new_node(std::make_unique<Node>(std::move(element)));
-	Node *new_back = new_node.get();
-	{
-		std::lock_guard<std::mutex> lock_back(m_mutex_back);
-		m_node_back->m_data = std::move(new_node->m_data);
-		m_node_back->next = std::move(new_node);
-		m_node_back = new_back;
-	}
-	m_cond.notify_one();
+template<typename Element, typename Allocator>
+void ThreadSafeQueue2<Element, Allocator>::push(const Element &element) {
+	pushElement(element);
 }
 
-template<typename Element>
+template<typename Element, typename Allocator>
+void ThreadSafeQueue2<Element, Allocator>::push(Element &&element) {
+	pushElement(std::move(element));
+}
+
+template<typename Element, typename Allocator>
 template<typename ...Ts>
-void ThreadSafeQueue2<Element>::emplace(Ts &&... pars) {
-	NodePtr new_node(std::make_unique<Node>(std::forward<Ts>(pars)...));
-	Node *new_back = new_node.get();
-	{
-		std::lock_guard<std::mutex> lock_back(m_mutex_back);
-		m_node_back->m_data = std::move(new_node->m_data);
-		m_node_back->next = std::move(new_node);
-		m_node_back = new_back;
-	}
-	m_cond.notify_one();
+void ThreadSafeQueue2<Element, Allocator>::emplace(Ts &&... pars) {
+	pushElement(std::forward<Ts>(pars)...);
 }
 
-template<typename Element>
-typename ThreadSafeQueue2<Element>::ElementPtr ThreadSafeQueue2<Element>::waitPop() {
+// unlinks the dummy node (the front mutex must be held, the queue non-empty);
+// the next node becomes the dummy node once its element is destroyed
+template<typename Element, typename Allocator>
+typename ThreadSafeQueue2<Element, Allocator>::Node* ThreadSafeQueue2<Element,
+		Allocator>::popNode() {
+	Node *old_front = m_node_front;
+	m_node_front = old_front->next;
+	return old_front;
+}
+
+template<typename Element, typename Allocator>
+typename ThreadSafeQueue2<Element, Allocator>::ElementPtr ThreadSafeQueue2<
+		Element, Allocator>::waitPop() {
 	std::unique_lock<std::mutex> lock_front(m_mutex_front);
 	m_cond.wait(lock_front, [this]() -> bool {
-		return m_node_front->next;
+		return m_node_front != getBackLabel();
 	});
-	NodePtr front_node(std::move(m_node_front));
-	m_node_front = std::move(front_node->next);
-	return std::move(front_node->m_data);
+	ElementPtr front_element(
+			std::make_unique<Element>(std::move(*m_node_front->next->data())));
+	Node *old_front = popNode();
+	m_node_front->data()->~Element();
+	lock_front.unlock();
+	Allocator::destroy(old_front);
+	return front_element;
 }
 
-template<typename Element>
-typename ThreadSafeQueue2<Element>::ElementPtr ThreadSafeQueue2<Element>::tryPop() {
+template<typename Element, typename Allocator>
+typename ThreadSafeQueue2<Element, Allocator>::ElementPtr ThreadSafeQueue2<
+		Element, Allocator>::tryPop() {
 	std::unique_lock<std::mutex> lock_front(m_mutex_front);
-	if (!m_node_front->next)
+	if (m_node_front == getBackLabel())
 		return ElementPtr(nullptr);
-	NodePtr front_node(std::move(m_node_front));
-	m_node_front = std::move(front_node->next);
-	return std::move(front_node->m_data);
+	ElementPtr front_element(
+			std::make_unique<Element>(std::move(*m_node_front->next->data())));
+	Node *old_front = popNode();
+	m_node_front->data()->~Element();
+	lock_front.unlock();
+	Allocator::destroy(old_front);
+	return front_element;
+}
+
+template<typename Element, typename Allocator>
+bool ThreadSafeQueue2<Element, Allocator>::tryPop(Element &element) {
+	std::unique_lock<std::mutex> lock_front(m_mutex_front);
+	if (m_node_front == getBackLabel())
+		return false;
+	element = std::move(*m_node_front->next->data());
+	Node *old_front = popNode();
+	m_node_front->data()->~Element();
+	lock_front.unlock();
+	Allocator::destroy(old_front);
+	return true;
 }
 #endif /* THREADSAFE_QUEUE2_H_ */
@@ -0,0 +1,227 @@
+/*
+ * threadsafe_stack5.h
+ *
+ * Lock-free thread-safe unbounded stack implemented using a singly-linked list
+ * of raw pointers (Treiber stack) with elimination backoff (D. Hendler,
+ * N. Shavit, L. Yerushalmi). After a failed compare-exchange on the head, a
+ * push offers its node in a randomly chosen slot of an elimination array and
+ * a pop tries to take a node offered there; a push and a pop that meet cancel
+ * each other out without touching the head. Memory reclamation and node
+ * allocation policies as in ThreadSafeStack4.
+ *
+ */
+
+#ifndef THREADSAFE_STACK5_H_
+#define THREADSAFE_STACK5_H_
+
+#include <memory> // std::unique_ptr
+#include <utility> // std::move, std::forward
+#include <atomic> // std::atomic
+#include <cstdint> // std::uint32_t, std::uintptr_t
+#include <exception> // std::exception
+#include "hazard_pointers.h"
+#include "node_pool.h"
+
+// number of slots of the elimination array
+constexpr size_t kEliminationSlots = 16;
+
+// number of times a push polls its offer before withdrawing it
+constexpr size_t kEliminationSpins = 128;
+
+template<typename Element, typename Reclaimer = hazard_pointer_domain,
+		typename Allocator = default_node_allocator>
+class ThreadSafeStack5 {
+	typedef std::unique_ptr<Element> ElementUPtr;
+
+	struct EmptyStack: public std::exception {
+		virtual const char* what() const noexcept (true) override {
+			return "Empty stack";
+		}
+	};
+
+	struct Node {
+		template<typename ...Ts>
+		Node(Ts &&... pars) :
+				m_data(std::forward<Ts>(pars)...), next(nullptr) {
+		}
+		~Node() = default;
+		Element m_data;
+		Node *next;
+	};
+
+	// node offered by a waiting push, on its own cache line
+	struct Slot {
+		Slot() :
+				offer(nullptr) {
+		}
+		std::atomic<Node*> offer;
+		char padding[64 - sizeof(std::atomic<Node*>)];
+	};
+public:
+	ThreadSafeStack5();
+	~ThreadSafeStack5();
+	ThreadSafeStack5(const ThreadSafeStack5&) = delete;
+	ThreadSafeStack5& operator=(const ThreadSafeStack5&) = delete;
+	ThreadSafeStack5(ThreadSafeStack5&&) = delete;
+	ThreadSafeStack5& operator=(ThreadSafeStack5&&) = delete;
+
+	bool empty() const;
+	void push(const Element &element);
+	void push(Element &&element);
+	template<typename ...Ts>
+	void emplace(Ts &&... pars);
+	std::unique_ptr<Element> tryPop();
+	bool tryPop(Element &element);
+private:
+	void pushNode(Node *new_node);
+	Node* popNode(typename Reclaimer::guard &guard);
+	bool eliminatePush(Node *new_node);
+	Node* eliminatePop(typename Reclaimer::guard &guard);
+	static Slot& randomSlot(Slot *slots);
+
+	std::atomic<Node*> m_head;
+	char m_padding[64 - sizeof(std::atomic<Node*>)];
+	Slot m_slots[kEliminationSlots];
+};
+
+template<typename Element, typename Reclaimer, typename Allocator>
+ThreadSafeStack5<Element, Reclaimer, Allocator>::ThreadSafeStack5() :
+		m_head(nullptr) {
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+ThreadSafeStack5<Element, Reclaimer, Allocator>::~ThreadSafeStack5() {
+	Node *node = m_head.load(std::memory_order_relaxed);
+	while (node) {
+		Node *next = node->next;
+		Allocator::destroy(node);
+		node = next;
+	}
+}
+
+// xorshift generator per thread, seeded by the address of its state
+template<typename Element, typename Reclaimer, typename Allocator>
+typename ThreadSafeStack5<Element, Reclaimer, Allocator>::Slot& ThreadSafeStack5<
+		Element, Reclaimer, Allocator>::randomSlot(Slot *slots) {
+	static thread_local std::uint32_t state = 0;
+	if (!state)
+		state = std::uint32_t(reinterpret_cast<std::uintptr_t>(&state) >> 4)
+				| 1;
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return slots[state % kEliminationSlots];
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+bool ThreadSafeStack5<Element, Reclaimer, Allocator>::empty() const {
+	return !m_head.load(std::memory_order_relaxed);
+}
+
+// offers the node to a pop, true if a pop took it
+template<typename Element, typename Reclaimer, typename Allocator>
+bool ThreadSafeStack5<Element, Reclaimer, Allocator>::eliminatePush(
+		Node *new_node) {
+	Slot &slot = randomSlot(m_slots);
+	Node *expected = nullptr;
+	if (!slot.offer.compare_exchange_strong(expected, new_node,
+			std::memory_order_release, std::memory_order_relaxed))
+		return false; // another push waits in the slot
+	// keep the node from being reclaimed and reused once taken, so that
+	// finding it in the slot means it is still on offer (ABA)
+	typename Reclaimer::guard guard;
+	if (guard.protect(slot.offer) != new_node)
+		return true;
+	for (size_t i = 0; i < kEliminationSpins; ++i)
+		if (slot.offer.load(std::memory_order_relaxed) != new_node)
+			return true;
+	expected = new_node;
+	return !slot.offer.compare_exchange_strong(expected, nullptr,
+			std::memory_order_relaxed, std::memory_order_relaxed);
+}
+
+// takes a node offered by a waiting push (nullptr if none), the node stays
+// protected by the guard
+template<typename Element, typename Reclaimer, typename Allocator>
+typename ThreadSafeStack5<Element, Reclaimer, Allocator>::Node* ThreadSafeStack5<
+		Element, Reclaimer, Allocator>::eliminatePop(
+		typename Reclaimer::guard &guard) {
+	Slot &slot = randomSlot(m_slots);
+	Node *offer = guard.protect(slot.offer);
+	if (offer
+			&& slot.offer.compare_exchange_strong(offer, nullptr,
+					std::memory_order_acquire, std::memory_order_relaxed))
+		return offer;
+	return nullptr;
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+void ThreadSafeStack5<Element, Reclaimer, Allocator>::pushNode(Node *new_node) {
+	new_node->next = m_head.load(std::memory_order_relaxed);
+	while (!m_head.compare_exchange_weak(new_node->next, new_node,
+			std::memory_order_release, std::memory_order_relaxed)) {
+		if (eliminatePush(new_node))
+			return;
+		new_node->next = m_head.load(std::memory_order_relaxed);
+	}
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+void ThreadSafeStack5<Element, Reclaimer, Allocator>::push(const Element &element) {
+	pushNode(Allocator::template create<Node>(element));
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+void ThreadSafeStack5<Element, Reclaimer, Allocator>::push(Element &&element) {
+	pushNode(Allocator::template create<Node>(std::move(element)));
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+template<typename ...Ts>
+void ThreadSafeStack5<Element, Reclaimer, Allocator>::emplace(Ts &&... pars) {
+	pushNode(Allocator::template create<Node>(std::forward<Ts>(pars)...));
+}
+
+// unlinks the top node or takes one from a waiting push, the node stays
+// protected by the guard (nullptr if empty)
+template<typename Element, typename Reclaimer, typename Allocator>
+typename ThreadSafeStack5<Element, Reclaimer, Allocator>::Node* ThreadSafeStack5<
+		Element, Reclaimer, Allocator>::popNode(typename Reclaimer::guard &guard) {
+	while (true) {
+		Node *old_head = guard.protect(m_head);
+		if (!old_head)
+			return nullptr;
+		if (m_head.compare_exchange_weak(old_head, old_head->next,
+				std::memory_order_acquire, std::memory_order_relaxed))
+			return old_head;
+		if (Node *node = eliminatePop(guard))
+			return node;
+	}
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+std::unique_ptr<Element> ThreadSafeStack5<Element, Reclaimer, Allocator>::tryPop() {
+	typename Reclaimer::guard guard;
+	Node *old_head = popNode(guard);
+	if (!old_head)
+		return std::unique_ptr<Element>(nullptr);
+	guard.reset();
+	ElementUPtr front_element(
+			std::make_unique<Element>(std::move(old_head->m_data)));
+	Reclaimer::template retire<Node, Allocator>(old_head);
+	return front_element;
+}
+
+template<typename Element, typename Reclaimer, typename Allocator>
+bool ThreadSafeStack5<Element, Reclaimer, Allocator>::tryPop(Element &element) {
+	typename Reclaimer::guard guard;
+	Node *old_head = popNode(guard);
+	if (!old_head)
+		return false;
+	guard.reset();
+	element = std::move(old_head->m_data);
+	Reclaimer::template retire<Node, Allocator>(old_head);
+	return true;
+}
+
+#endif /* THREADSAFE_STACK5_H_ */
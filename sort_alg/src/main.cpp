@@ -15,6 +15,10 @@
 #include "timer.h"
 #include "serial_sort.h"
 #include "parallel_sort.h"
+#include "parallel_partition.h"
+#include "parallel_select.h"
+#include "parallel_sort_by_key.h"
+#include "parallel_string_sort.h"
 using namespace std;
 
 void usageMsg(void) {
@@ -59,6 +63,36 @@ void addElements(list<T> &v, const size_t Nel) {
 		v.emplace_back(rand() % Nel + 1);
 }
 
+// 200-byte record sorted by key
+struct Record {
+	int key;
+	int payload[49];
+};
+
+// Element ordered by key only, index records the input position (stability)
+struct Item {
+	int key;
+	int index;
+	bool operator<(const Item &rhs) const {
+		return key < rhs.key;
+	}
+};
+
+// true if the items are sorted by key and equal keys keep their input order
+template<typename Container>
+bool isStablySorted(const Container &items) {
+	return is_sorted(items.begin(), items.end(),
+			[](const Item &a, const Item &b) {
+				return a.key < b.key || (a.key == b.key && a.index < b.index);
+			});
+}
+
+template<typename T>
+void addElements(vector<T> &v, const size_t Nel) {
+	for (size_t ii = 0; ii < Nel; ++ii)
+		v.emplace_back(rand() % Nel + 1);
+}
+
 int main(int argc, char *argv[]) {
 
 	if (argc < 3)
@@ -124,5 +158,360 @@ int main(int argc, char *argv[]) {
 		cout << separator << endl;
 	}
 
+	{
+		// Serial vs parallel sort of a contiguous range
+		vector<int> elements;
+		addElements(elements, kNelements);
+		vector<int> expected(elements);
+		sort(expected.begin(), expected.end());
+		const char *names[] = { "Serial sort (vector)", "Parallel sort (vector)" };
+		for (size_t mode = 0; mode < 2; ++mode) {
+			bool matches = true;
+			results.clear();
+			for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+				vector<int> input(elements);
+				timer.start();
+				if (mode == 0)
+					sort(input.begin(), input.end());
+				else
+					parallel_sort(input.begin(), input.end(), kNthreads);
+				timer.stop();
+				results.push_back(timer.duration());
+				matches = matches && input == expected;
+			}
+
+			// Report result
+			cout << separator << endl;
+			cout << names[mode] << " (avg of " << kNiter << " runs)" << endl;
+			cout << "Matches serial: " << (matches ? "yes" : "no") << endl;
+			cout << "Test duration: " << setw(kNsetwNumber)
+					<< calcMeanStd(results) << " [ms]" << endl;
+			cout << separator << endl;
+		}
+	}
+
+	{
+		// Serial vs parallel partition, stable_partition and copy_if
+		vector<int> elements;
+		addElements(elements, kNelements);
+		auto is_even = [](const int val) {
+			return val % 2 == 0;
+		};
+		vector<int> expected(elements);
+		stable_partition(expected.begin(), expected.end(), is_even);
+		const size_t Neven = count_if(elements.begin(), elements.end(), is_even);
+		const char *names[] = { "Serial partition", "Parallel partition",
+				"Serial stable_partition", "Parallel stable_partition",
+				"Serial copy_if", "Parallel copy_if" };
+		for (size_t mode = 0; mode < 6; ++mode) {
+			bool matches = true;
+			results.clear();
+			for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+				vector<int> input(elements);
+				vector<int> output(elements.size());
+				vector<int>::iterator stop;
+				timer.start();
+				switch (mode) {
+				case 0:
+					stop = partition(input.begin(), input.end(), is_even);
+					break;
+				case 1:
+					stop = parallel_partition(input.begin(), input.end(),
+							is_even, kNthreads);
+					break;
+				case 2:
+					stop = stable_partition(input.begin(), input.end(), is_even);
+					break;
+				case 3:
+					stop = parallel_stable_partition(input.begin(), input.end(),
+							is_even, kNthreads);
+					break;
+				case 4:
+					stop = copy_if(elements.begin(), elements.end(),
+							output.begin(), is_even);
+					break;
+				default:
+					stop = parallel_copy_if(elements.begin(), elements.end(),
+							output.begin(), is_even, kNthreads);
+				}
+				timer.stop();
+				results.push_back(timer.duration());
+
+				// unstable partitions: boundary and element multiset, stable
+				// partitions and copy_if: exact order
+				if (mode < 2) {
+					matches = matches
+							&& stop - input.begin() == (ptrdiff_t) Neven
+							&& all_of(input.begin(), stop, is_even)
+							&& none_of(stop, input.end(), is_even);
+					sort(input.begin(), input.end());
+					vector<int> sorted(elements);
+					sort(sorted.begin(), sorted.end());
+					matches = matches && input == sorted;
+				} else if (mode < 4) {
+					matches = matches && input == expected
+							&& stop - input.begin() == (ptrdiff_t) Neven;
+				} else {
+					matches = matches
+							&& stop - output.begin() == (ptrdiff_t) Neven
+							&& equal(output.begin(), stop, expected.begin());
+				}
+			}
+
+			// Report result
+			cout << separator << endl;
+			cout << names[mode] << " (avg of " << kNiter << " runs)" << endl;
+			cout << "Matches serial: " << (matches ? "yes" : "no") << endl;
+			cout << "Test duration: " << setw(kNsetwNumber)
+					<< calcMeanStd(results) << " [ms]" << endl;
+			cout << separator << endl;
+		}
+	}
+
+	{
+		// Serial vs parallel top-k, nth_element (median) and partial_sort (1%)
+		vector<int> elements;
+		addElements(elements, kNelements);
+		const size_t k = 100;
+		const size_t Nprefix = kNelements / 100 + 1;
+		vector<int> expected(elements);
+		sort(expected.begin(), expected.end());
+		const char *names[] = { "Serial top-k", "Parallel top-k",
+				"Serial nth_element", "Parallel nth_element",
+				"Serial partial_sort", "Parallel partial_sort" };
+		for (size_t mode = 0; mode < 6; ++mode) {
+			bool matches = true;
+			results.clear();
+			for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+				vector<int> input(elements);
+				vector<int> top(min(k, elements.size()));
+				timer.start();
+				switch (mode) {
+				case 0:
+					partial_sort_copy(input.begin(), input.end(), top.begin(),
+							top.end(), greater<int>());
+					break;
+				case 1:
+					top = parallel_top_k(input.begin(), input.end(), k,
+							kNthreads);
+					break;
+				case 2:
+					nth_element(input.begin(), input.begin() + kNelements / 2,
+							input.end());
+					break;
+				case 3:
+					parallel_nth_element(input.begin(),
+							input.begin() + kNelements / 2, input.end(),
+							kNthreads);
+					break;
+				case 4:
+					partial_sort(input.begin(), input.begin() + Nprefix,
+							input.end());
+					break;
+				default:
+					parallel_partial_sort(input.begin(), input.begin() + Nprefix,
+							input.end(), kNthreads);
+				}
+				timer.stop();
+				results.push_back(timer.duration());
+
+				if (mode < 2)
+					matches = matches
+							&& equal(top.begin(), top.end(), expected.rbegin());
+				else if (mode < 4)
+					matches = matches
+							&& input[kNelements / 2] == expected[kNelements / 2];
+				else
+					matches = matches
+							&& equal(input.begin(), input.begin() + Nprefix,
+									expected.begin());
+			}
+
+			// Report result
+			cout << separator << endl;
+			cout << names[mode] << " (avg of " << kNiter << " runs)" << endl;
+			cout << "Matches serial: " << (matches ? "yes" : "no") << endl;
+			cout << "Test duration: " << setw(kNsetwNumber)
+					<< calcMeanStd(results) << " [ms]" << endl;
+			cout << separator << endl;
+		}
+	}
+
+	{
+		// Direct vs indirect sort of large records (Nelements / 8 records)
+		const size_t kNrecords = kNelements / 8;
+		vector<Record> records(kNrecords);
+		for (size_t ii = 0; ii < kNrecords; ++ii) {
+			records[ii].key = rand() % kNrecords;
+			fill(begin(records[ii].payload), end(records[ii].payload), (int) ii);
+		}
+		auto by_key = [](const Record &a, const Record &b) {
+			return a.key < b.key;
+		};
+		vector<Record> expected(records);
+		stable_sort(expected.begin(), expected.end(), by_key);
+		const char *names[] = { "Serial sort (records)",
+				"Parallel sort (records)", "Parallel sort_indirect (records)",
+				"Parallel sort_by_key (records)" };
+		for (size_t mode = 0; mode < 4; ++mode) {
+			bool matches = true;
+			results.clear();
+			for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+				vector<Record> input(records);
+				vector<int> keys(kNrecords);
+				for (size_t ii = 0; ii < kNrecords; ++ii)
+					keys[ii] = input[ii].key;
+				timer.start();
+				switch (mode) {
+				case 0:
+					sort(input.begin(), input.end(), by_key);
+					break;
+				case 1:
+					parallel_sort(input.begin(), input.end(), kNthreads, by_key);
+					break;
+				case 2:
+					parallel_sort_indirect(input.begin(), input.end(),
+							[](const Record &record) {
+								return record.key;
+							}, kNthreads);
+					break;
+				default:
+					parallel_sort_by_key(keys.begin(), keys.end(), input.begin(),
+							kNthreads);
+				}
+				timer.stop();
+				results.push_back(timer.duration());
+
+				// unstable sorts: keys in order, stable sorts: exact order
+				for (size_t ii = 0; ii < kNrecords && matches; ++ii)
+					matches = input[ii].key == expected[ii].key
+							&& (mode < 2
+									|| input[ii].payload[0]
+											== expected[ii].payload[0])
+							&& (mode < 3 || keys[ii] == expected[ii].key);
+			}
+
+			// Report result
+			cout << separator << endl;
+			cout << names[mode] << " (avg of " << kNiter << " runs)" << endl;
+			cout << "Matches serial: " << (matches ? "yes" : "no") << endl;
+			cout << "Test duration: " << setw(kNsetwNumber)
+					<< calcMeanStd(results) << " [ms]" << endl;
+			cout << separator << endl;
+		}
+	}
+
+	{
+		// Unstable vs stable parallel sort, many equal keys
+		vector<Item> items(kNelements);
+		for (size_t ii = 0; ii < kNelements; ++ii)
+			items[ii] = Item { (int) (rand() % (kNelements / 16 + 1)), (int) ii };
+		const list<Item> itemsList(items.begin(), items.end());
+		const char *names[] = { "Parallel sort (list)",
+				"Parallel stable_sort (list)", "Serial stable_sort (vector)",
+				"Parallel sort (vector)", "Parallel stable_sort (vector)" };
+		for (size_t mode = 0; mode < 5; ++mode) {
+			bool stable = true;
+			results.clear();
+			for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+				if (mode < 2) {
+					list<Item> input(itemsList);
+					timer.start();
+					list<Item> result =
+							mode == 0 ?
+									parallel_sort(move(input), kNthreads) :
+									parallel_stable_sort(move(input), kNthreads);
+					timer.stop();
+					stable = stable && isStablySorted(result);
+				} else {
+					vector<Item> input(items);
+					timer.start();
+					if (mode == 2)
+						stable_sort(input.begin(), input.end());
+					else if (mode == 3)
+						parallel_sort(input.begin(), input.end(), kNthreads);
+					else
+						parallel_stable_sort(input.begin(), input.end(),
+								kNthreads);
+					timer.stop();
+					stable = stable && isStablySorted(input);
+				}
+				results.push_back(timer.duration());
+			}
+
+			// Report result
+			cout << separator << endl;
+			cout << names[mode] << " (avg of " << kNiter << " runs)" << endl;
+			cout << "Stable: " << (stable ? "yes" : "no") << endl;
+			cout << "Test duration: " << setw(kNsetwNumber)
+					<< calcMeanStd(results) << " [ms]" << endl;
+			cout << separator << endl;
+		}
+	}
+
+	{
+		// String sort of URL-like keys with long shared prefixes (Nelements / 4 keys)
+		const size_t kNstrings = kNelements / 4;
+		const char *hosts[] = { "https://www.example.com/", "https://api.example.com/v2/" };
+		const char *dirs[] = { "static/assets/images/", "users/profile/settings/",
+				"reports/2024/quarterly/" };
+		vector<string> strings(kNstrings);
+		for (size_t ii = 0; ii < kNstrings; ++ii)
+			strings[ii] = string(hosts[rand() % 2]) + dirs[rand() % 3]
+					+ to_string(rand() % (kNstrings + 1)) + "/index.html";
+		vector<string> expected(strings);
+		sort(expected.begin(), expected.end());
+		const char *names[] = { "Parallel sort (string list)",
+				"Parallel string_sort (string list)", "Serial sort (string vector)",
+				"Parallel string_sort (string vector)" };
+		for (size_t mode = 0; mode < 4; ++mode) {
+			bool matches = true;
+			results.clear();
+			for (size_t iterNo = 0; iterNo < kNiter; ++iterNo) {
+				vector<size_t> lcp;
+				if (mode < 2) {
+					list<string> input(strings.begin(), strings.end());
+					timer.start();
+					list<string> result =
+							mode == 0 ?
+									parallel_sort(move(input), kNthreads) :
+									parallel_string_sort(move(input), kNthreads,
+											&lcp);
+					timer.stop();
+					matches = matches
+							&& equal(result.begin(), result.end(),
+									expected.begin());
+				} else {
+					vector<string> input(strings);
+					timer.start();
+					if (mode == 2)
+						sort(input.begin(), input.end());
+					else
+						parallel_string_sort(input, kNthreads, &lcp);
+					timer.stop();
+					matches = matches && input == expected;
+				}
+				results.push_back(timer.duration());
+
+				// lcp of every key with its predecessor
+				for (size_t ii = 1; ii < lcp.size() && matches; ++ii)
+					matches = expected[ii].compare(0, lcp[ii], expected[ii - 1],
+							0, lcp[ii]) == 0
+							&& (lcp[ii] == min(expected[ii].size(),
+									expected[ii - 1].size())
+									|| expected[ii][lcp[ii]]
+											!= expected[ii - 1][lcp[ii]]);
+			}
+
+			// Report result
+			cout << separator << endl;
+			cout << names[mode] << " (avg of " << kNiter << " runs)" << endl;
+			cout << "Matches serial: " << (matches ? "yes" : "no") << endl;
+			cout << "Test duration: " << setw(kNsetwNumber)
+					<< calcMeanStd(results) << " [ms]" << endl;
+			cout << separator << endl;
+		}
+	}
+
 	return 0;
 }